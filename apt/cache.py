@@ -21,8 +21,10 @@
 
 from __future__ import print_function
 
+import asyncio
 import fnmatch
 import os
+import threading
 import warnings
 import weakref
 
@@ -56,6 +58,10 @@ class CacheClosedException(Exception):
     """Exception that is thrown when the cache is used after close()."""
 
 
+# update() changes the global apt_pkg.config, so updates must not overlap
+_update_lock = threading.Lock()
+
+
 class _WrappedLock(object):
     """Wraps an apt_pkg.FileLock to raise LockFailedException.
 
@@ -547,42 +553,72 @@ class Cache(object):
         .
         sources_list -- Update a alternative sources.list than the default.
         Note that the sources.list.d directory is ignored in this case
-        """
-        with _WrappedLock(apt_pkg.config.find_dir("Dir::State::Lists")):
-            if sources_list:
-                old_sources_list = apt_pkg.config.find("Dir::Etc::sourcelist")
-                old_sources_list_d = (
-                    apt_pkg.config.find("Dir::Etc::sourceparts"))
-                old_cleanup = apt_pkg.config.find("APT::List-Cleanup")
-                apt_pkg.config.set("Dir::Etc::sourcelist",
-                                   os.path.abspath(sources_list))
-                apt_pkg.config.set("Dir::Etc::sourceparts", "xxx")
-                apt_pkg.config.set("APT::List-Cleanup", "0")
-                slist = apt_pkg.SourceList()
-                slist.read_main_list()
-            else:
-                slist = self._list
 
-            try:
-                if fetch_progress is None:
-                    fetch_progress = apt.progress.base.AcquireProgress()
-                try:
-                    res = self._cache.update(fetch_progress, slist,
-                                             pulse_interval)
-                except SystemError as e:
-                    raise FetchFailedException(e)
-                if not res and raise_on_error:
-                    raise FetchFailedException()
-                else:
-                    return res
-            finally:
+        Updates change the global apt_pkg.config, so updates of all caches
+        in the process, including those by update_async(), run one after
+        another.
+        """
+        with _update_lock:
+            with _WrappedLock(apt_pkg.config.find_dir("Dir::State::Lists")):
                 if sources_list:
+                    old_sources_list = (
+                        apt_pkg.config.find("Dir::Etc::sourcelist"))
+                    old_sources_list_d = (
+                        apt_pkg.config.find("Dir::Etc::sourceparts"))
+                    old_cleanup = apt_pkg.config.find("APT::List-Cleanup")
                     apt_pkg.config.set("Dir::Etc::sourcelist",
-                                       old_sources_list)
-                    apt_pkg.config.set("Dir::Etc::sourceparts",
-                                       old_sources_list_d)
-                    apt_pkg.config.set("APT::List-Cleanup",
-                                       old_cleanup)
+                                       os.path.abspath(sources_list))
+                    apt_pkg.config.set("Dir::Etc::sourceparts", "xxx")
+                    apt_pkg.config.set("APT::List-Cleanup", "0")
+                    slist = apt_pkg.SourceList()
+                    slist.read_main_list()
+                else:
+                    slist = self._list
+
+                try:
+                    # Without a progress object, the GIL is released while
+                    # fetching.
+                    try:
+                        res = self._cache.update(fetch_progress, slist,
+                                                 pulse_interval)
+                    except SystemError as e:
+                        raise FetchFailedException(e)
+                    if not res and raise_on_error:
+                        raise FetchFailedException()
+                    else:
+                        return res
+                finally:
+                    if sources_list:
+                        apt_pkg.config.set("Dir::Etc::sourcelist",
+                                           old_sources_list)
+                        apt_pkg.config.set("Dir::Etc::sourceparts",
+                                           old_sources_list_d)
+                        apt_pkg.config.set("APT::List-Cleanup",
+                                           old_cleanup)
+
+    async def update_async(self, pulse_interval=0, raise_on_error=True,
+                           sources_list=None):
+        # type: (int, bool, Optional[str]) -> int
+        """Run the equivalent of apt-get update without blocking the loop.
+
+        This is a coroutine which runs update() without a progress object
+        in the default executor of the running event loop, so other tasks
+        keep running while the index files are fetched. The parameters
+        are the same as for update().
+
+        This does not block the loop, but it does not fetch in parallel
+        either: updates change the global apt_pkg.config, so concurrent
+        calls, also for different caches or chroots, and calls of update()
+        run one after another. Use apt_pkg.Acquire.run_async() with
+        events=True for progress reporting.
+        """
+        def update():
+            # type: () -> int
+            return self.update(None, pulse_interval, raise_on_error,
+                               sources_list)
+
+        loop = asyncio.get_running_loop()
+        return await loop.run_in_executor(None, update)
 
     def install_archives(self, pm, install_progress):
         # type: (apt_pkg.PackageManager, InstallProgress) -> int
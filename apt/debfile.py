@@ -54,6 +54,7 @@ class DebPackage(object):
             cache = apt.Cache()
         self._cache = cache
         self._debfile = cast(apt_inst.DebFile, None)
+        self._data_lookups = 0
         self.pkgname = ""
         self.filename = None  # type: Optional[str]
         self._sections = {}  # type: Union[Dict[str, str], apt_pkg.TagSection[str]]  # noqa
@@ -73,6 +74,7 @@ class DebPackage(object):
         self._failure_string = ""
         self.filename = filename
         self._debfile = apt_inst.DebFile(self.filename)
+        self._data_lookups = 0
         control = self._debfile.control.extractdata("control")
         self._sections = apt_pkg.TagSection(control)
         self.pkgname = self._sections["Package"]
@@ -90,9 +92,8 @@ class DebPackage(object):
     def filelist(self):
         # type: () -> List[str]
         """return the list of files in the deb."""
-        files = []
         try:
-            self._debfile.data.go(lambda item, data: files.append(item.name))
+            files = self._debfile.data.getnames()
         except SystemError:
             return [_("List of files for '%s' could not be read") %
                     self.filename]
@@ -102,10 +103,8 @@ class DebPackage(object):
     def control_filelist(self):
         # type: () -> List[str]
         """ return the list of files in control.tar.gz """
-        control = []
         try:
-            self._debfile.control.go(
-                lambda item, data: control.append(item.name))
+            control = self._debfile.control.getnames()
         except SystemError:
             return [_("List of control files for '%s' could not be read") %
                     self.filename]
@@ -705,6 +704,15 @@ class DebPackage(object):
     def data_content(self, name):
         # type: (str) -> str
         """ return the content of a specific control.tar.gz file """
+        # Index the members once they are looked at more than once, so that
+        # later lookups do not read through the archive up to the member.
+        # Without the index, the archive is read as before.
+        self._data_lookups += 1
+        if self._data_lookups == 2:
+            try:
+                self._debfile.data.build_index()
+            except SystemError:
+                pass
         try:
             return self._get_content(self._debfile.data, name)
         except LookupError:
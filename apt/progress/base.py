@@ -29,7 +29,6 @@ import fcntl
 import io
 import os
 import re
-import select
 import sys
 
 from typing import Optional, Union
@@ -49,6 +48,7 @@ class AcquireProgress(object):
     current_bytes = current_cps = fetched_bytes = last_bytes = total_bytes \
                   = 0.0
     current_items = elapsed_time = total_items = 0
+    cache_hits = cache_misses = 0
 
     def done(self, item):
         # type: (apt_pkg.AcquireItemDesc) -> None
@@ -155,6 +155,7 @@ class InstallProgress(object):
     """Class to report the progress of installing packages."""
 
     child_pid, percent, select_timeout, status = 0, 0.0, 0.1, ""
+    _status_read = False
 
     def __init__(self):
         # type: () -> None
@@ -255,6 +256,7 @@ class InstallProgress(object):
     def update_interface(self):
         # type: () -> None
         """Update the interface."""
+        self._status_read = False
         try:
             line = self.status_stream.readline()
         except IOError as err:
@@ -262,6 +264,7 @@ class InstallProgress(object):
             if err.errno != errno.EAGAIN and err.errno != errno.EWOULDBLOCK:
                 print(err.strerror)
             return
+        self._status_read = bool(line)
 
         pkgname = status = status_str = percent = base = ""
 
@@ -307,29 +310,32 @@ class InstallProgress(object):
         This method is responsible for calling update_interface() from time to
         time. It exits once the child has exited. The return values is the
         full status returned from os.waitpid() (not only the return code).
+
+        update_interface() is called when there is status output. If a
+        subclass overrides update_interface(), it is also called after
+        select_timeout seconds without output, to keep its interface alive.
+        The status pipe and the exit of the child are waited for with
+        apt_pkg.wait_child(), which does not poll.
         """
-        (pid, res) = (0, 0)
-        while True:
-            try:
-                select.select([self.status_stream], [], [],
-                              self.select_timeout)
-            except select.error as error:
-                (errno_, _errstr) = error.args
-                if errno_ != errno.EINTR:
-                    raise
+        timeout = -1.0
+        if type(self).update_interface is not InstallProgress.update_interface:
+            timeout = self.select_timeout
+        res = apt_pkg.wait_child(self.child_pid, self.statusfd,
+                                 self._update_status, timeout)
+        self._update_status()
+        return res
 
-            self.update_interface()
-            try:
-                (pid, res) = os.waitpid(self.child_pid, os.WNOHANG)
-                if pid == self.child_pid:
-                    break
-            except OSError as err:
-                if err.errno == errno.ECHILD:
-                    break
-                if err.errno != errno.EINTR:
-                    raise
+    def _update_status(self):
+        # type: () -> None
+        """Call update_interface() until the status read so far is handled.
 
-        return res
+        Lines may be buffered in status_stream, where the file descriptor
+        being readable does not announce them.
+        """
+        self._status_read = True
+        while self._status_read:
+            self._status_read = False
+            self.update_interface()
 
 
 class OpProgress(object):
@@ -24,6 +24,7 @@
 #include "apt_pkgmodule.h"
 
 #include <apt-pkg/acquire-item.h>
+#include <apt-pkg/fileutl.h>
 #include <map>
 
 using namespace std;
@@ -190,6 +191,9 @@ static PyObject *acquireitem_repr(PyObject *Self)
 
 static void acquireitem_dealloc(PyObject *self)
 {
+    CppPyObject<pkgAcquire::Item*> *obj = (CppPyObject<pkgAcquire::Item*> *)self;
+    if (!obj->NoDelete && obj->Object != 0)
+        PyAcquire_ForgetItem(obj->Owner, obj->Object);
     CppDeallocPtr<pkgAcquire::Item*>(self);
 }
 
@@ -234,6 +238,52 @@ PyTypeObject PyAcquireItem_Type = {
     acquireitem_getset,                   // tp_getset
 };
 
+/* pkgAcqFile which keeps the hashes the method calculated while writing
+ * the file, so they are available without reading it again. */
+class PyAcqFile : public pkgAcqFile
+{
+public:
+    HashStringList ReceivedHashes;
+
+    using pkgAcqFile::pkgAcqFile;
+
+    virtual void Done(std::string const &Message, HashStringList const &CalcHashes,
+                      pkgAcquire::MethodConfig const * const Cnf) override
+    {
+        ReceivedHashes = CalcHashes;
+        pkgAcqFile::Done(Message, CalcHashes, Cnf);
+    }
+
+    /* Fetch the item from DestFile, e.g. once it is linked from the content
+     * cache. It is then verified and completed like any other item. */
+    void FetchLocal()
+    {
+        Dequeue();
+        Desc.URI = "file:" + (DestFile[0] == '/' ? DestFile : SafeGetCWD() + DestFile);
+        QueueURI(Desc);
+    }
+};
+
+static PyObject *acquirefile_get_received_hashes(PyObject *self, void *closure)
+{
+    pkgAcquire::Item *item = acquireitem_tocpp(self);
+    if (item == 0)
+        return 0;
+    PyAcqFile *file = static_cast<PyAcqFile *>(item);
+    if (file->ReceivedHashes.empty())
+        Py_RETURN_NONE;
+    return CppPyObject_NEW<HashStringList>(nullptr, &PyHashStringList_Type,
+                                           file->ReceivedHashes);
+}
+
+static PyGetSetDef acquirefile_getset[] = {
+    {"received_hashes",acquirefile_get_received_hashes,NULL,
+     "The hashes of the fetched file as an apt_pkg.HashStringList, computed\n"
+     "by the method while the data was written, or None if the file has not\n"
+     "been fetched (yet)."},
+    {}
+};
+
 static PyObject *acquirefile_new(PyTypeObject *type, PyObject *Args, PyObject * kwds)
 {
     PyObject *pyfetcher;
@@ -241,18 +291,18 @@ static PyObject *acquirefile_new(PyTypeObject *type, PyObject *Args, PyObject *
     HashStringList hashes;
     const char *uri, *descr, *shortDescr;
     PyApt_Filename destDir, destFile;
-    int size = 0;
+    long long size = 0;
     uri = descr = shortDescr = destDir = destFile = "";
 
     char *kwlist[] = {"owner", "uri", "hash", "size", "descr", "short_descr",
                       "destdir", "destfile", NULL
                      };
 #if PY_MAJOR_VERSION >= 3
-    const char *fmt = "O!s|OissO&O&";
+    const char *fmt = "O!s|OLssO&O&";
 #else
     // no "$" support to indicate that the remaining args are keyword only
     // in py2.x :/
-    const char *fmt = "O!s|OissO&O&";
+    const char *fmt = "O!s|OLssO&O&";
 #endif
     if (PyArg_ParseTupleAndKeywords(Args, kwds, fmt, kwlist,
                                     &PyAcquire_Type, &pyfetcher, &uri,
@@ -271,15 +321,28 @@ static PyObject *acquirefile_new(PyTypeObject *type, PyObject *Args, PyObject *
     else
         return PyErr_SetString(PyExc_TypeError, "'hash' value must be an apt_pkg.HashStringList or a string"), nullptr;
 
+    if (size < 0)
+        return PyErr_SetString(PyExc_ValueError, "'size' must not be negative"), nullptr;
+    if (size == 0)
+        size = hashes.FileSize();
+
+    if (!PyAcquire_CheckIdle(pyfetcher))
+        return 0;
     pkgAcquire *fetcher = GetCpp<pkgAcquire*>(pyfetcher);
-    pkgAcqFile *af = new pkgAcqFile(fetcher,  // owner
-                                    uri, // uri
-                                    hashes,  // hash
-                                    size,   // size
-                                    descr, // descr
-                                    shortDescr,
-                                    destDir,
-                                    destFile); // short-desc
+    // Queues are assigned when the item is queued by its constructor
+    PyAcquireConfigScope scope(pyfetcher);
+    if (scope.Failed())
+        return 0;
+    PyAcqFile *af = new PyAcqFile(fetcher,  // owner
+                                  uri, // uri
+                                  hashes,  // hash
+                                  size,   // size
+                                  descr, // descr
+                                  shortDescr,
+                                  destDir,
+                                  destFile); // short-desc
+    if (PyAcquire_ContentCacheLink(pyfetcher, hashes, af->DestFile))
+        af->FetchLocal();
     CppPyObject<pkgAcqFile*> *AcqFileObj = CppPyObject_NEW<pkgAcqFile*>(pyfetcher, type);
     AcqFileObj->Object = af;
     return AcqFileObj;
@@ -307,7 +370,9 @@ static char *acquirefile_doc =
     "The parameters 'hash' and 'size' are used to verify the resulting\n"
     "file. The parameter 'size' is also to calculate the total amount\n"
     "of data to be fetched and is useful for resuming a interrupted\n"
-    "download.\n\n"
+    "download. It may exceed 2 GiB; if it is not given, the file size\n"
+    "of 'hash' is used, if any. The hashes are calculated while the data\n"
+    "is written, and are available as 'received_hashes' afterwards.\n\n"
     "All parameters can be given by name (i.e. as keyword arguments).";
 
 PyTypeObject PyAcquireFile_Type = {
@@ -343,7 +408,7 @@ PyTypeObject PyAcquireFile_Type = {
     0,                                   // tp_iternext
     0,                                   // tp_methods
     0,                                   // tp_members
-    0,                                   // tp_getset
+    acquirefile_getset,                  // tp_getset
     &PyAcquireItem_Type,                 // tp_base
     0,                                   // tp_dict
     0,                                   // tp_descr_get
@@ -28,7 +28,105 @@
 
 #include <apt-pkg/acquire-item.h>
 #include <apt-pkg/acquire-worker.h>
+#include <apt-pkg/configuration.h>
+#include <apt-pkg/fileutl.h>
+#include <apt-pkg/strutl.h>
+
+#include <string>
+#include <strings.h>
+#include <vector>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <linux/fs.h>
+#endif
+
+/* An Acquire object. Events is the fetch status if no progress object
+ * is used; it queues events if created with events=True. NoCallbacks is
+ * set if the fetcher does not call into Python, so that run() can release
+ * the GIL. Running is set while run() is in the fetcher, which is done by
+ * the thread RunThread; with a progress object, the GIL is released
+ * between the callbacks. Stats is exported through
+ * the buffer protocol and, like the item records, filled by Recorder.
+ * Options holds the process-wide fetch settings given to the constructor. */
+struct PyAcquireObject : public CppPyObject<pkgAcquire*> {
+    PyFetchEvents *Events;
+    PyFetchRecorder *Recorder;
+    PyAcquireOptions *Options;
+    bool NoCallbacks;
+    bool Running;
+    unsigned long RunThread;
+    PyFetchStats Stats;
+};
+
+/* The number of fetchers in run(), and the options of the one holding
+ * them in _config. Both are only changed with the GIL held. */
+static unsigned int PyAcquireRuns = 0;
+static PyAcquireOptions const *PyAcquireRunOptions = 0;
+
+PyAcquireConfigScope::PyAcquireConfigScope(PyObject *Acquire) : Conflict(false)
+{
+    if (Acquire != 0 && PyObject_TypeCheck(Acquire, &PyAcquire_Type))
+        Apply(((PyAcquireObject *)Acquire)->Options);
+}
+
+void PyAcquireConfigScope::Apply(PyAcquireOptions const *Options)
+{
+    if (Options == 0)
+        return;
+    // The running fetcher may add items with its own options in callbacks
+    if (PyAcquireRuns != 0 && Options != PyAcquireRunOptions) {
+        Conflict = true;
+        PyErr_SetString(PyExc_RuntimeError,
+                        "the fetch settings of an Acquire object cannot be "
+                        "applied while another Acquire object is running");
+        return;
+    }
+    for (auto const &Option : *Options) {
+        if (_config->Exists(Option.first))
+            Saved.push_back(std::make_pair(Option.first,
+                                           _config->Find(Option.first)));
+        else
+            Unset.push_back(Option.first);
+        _config->Set(Option.first, Option.second);
+    }
+}
+
+bool PyAcquire_BeginRun(PyAcquireOptions const *Options)
+{
+    if (PyAcquireRunOptions != 0) {
+        PyErr_SetString(PyExc_RuntimeError,
+                        "another Acquire object with fetch settings is running");
+        return false;
+    }
+    PyAcquireRuns++;
+    PyAcquireRunOptions = Options;
+    return true;
+}
+
+void PyAcquire_EndRun()
+{
+    PyAcquireRuns--;
+    PyAcquireRunOptions = 0;
+}
+
+PyAcquireConfigScope::~PyAcquireConfigScope()
+{
+    for (auto const &Option : Saved)
+        _config->Set(Option.first, Option.second);
+    for (auto const &Name : Unset)
+        _config->Clear(Name);
+}
 
+static PyFetchEvents *PkgAcquireEvents(PyObject *Self)
+{
+    PyFetchEvents *events = ((PyAcquireObject *)Self)->Events;
+    return (events != 0 && events->Queueing) ? events : 0;
+}
 
 static PyObject *acquireworker_get_current_item(PyObject *self, void *closure)
 {
@@ -221,25 +319,315 @@ PyTypeObject PyAcquireItemDesc_Type = {
     0,                                   // tp_new
 };
 
+/* Content-addressed download cache. If Acquire::Content-Cache names a
+ * directory, fetched archives and files are stored there under their
+ * SHA256 as <dir>/<first two digits>/<sha256>, and are linked from it
+ * instead of being fetched again, by this or any other fetcher. */
+static std::string ContentCachePath(HashStringList const &Hashes)
+{
+    std::string Dir = _config->Find("Acquire::Content-Cache");
+    HashString const *Hash = Hashes.find("SHA256");
+    if (Dir.empty() || Hash == 0 || Hash->HashValue().size() < 2)
+        return std::string();
+    return Dir + "/" + Hash->HashValue().substr(0, 2) + "/" + Hash->HashValue();
+}
+
+/* Create To as a hard link to From, or as a reflink or a copy if the
+ * two are on different file systems. To must not exist. */
+static bool ContentCacheClone(std::string const &From, std::string const &To)
+{
+    if (link(From.c_str(), To.c_str()) == 0)
+        return true;
+    if (errno != EXDEV && errno != EPERM && errno != EMLINK)
+        return false;
+
+    int In = open(From.c_str(), O_RDONLY | O_CLOEXEC);
+    if (In < 0)
+        return false;
+    int Out = open(To.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+    if (Out < 0) {
+        close(In);
+        return false;
+    }
+
+    bool Res = false;
+#ifdef FICLONE
+    Res = (ioctl(Out, FICLONE, In) == 0);
+#endif
+    if (Res == false) {
+        char Buffer[64 * 1024];
+        ssize_t Read;
+        Res = true;
+        while (Res && (Read = read(In, Buffer, sizeof(Buffer))) != 0) {
+            if (Read < 0) {
+                Res = (errno == EINTR);
+                continue;
+            }
+            for (ssize_t Done = 0, Written; Res && Done < Read; Done += Written) {
+                Written = write(Out, Buffer + Done, Read - Done);
+                if (Written < 0) {
+                    Res = (errno == EINTR);
+                    Written = 0;
+                }
+            }
+        }
+    }
+
+    close(In);
+    if (close(Out) != 0)
+        Res = false;
+    if (Res == false)
+        unlink(To.c_str());
+    return Res;
+}
+
+bool PyAcquire_ContentCacheLink(PyObject *Acquire, HashStringList const &Hashes,
+                                std::string const &Dest)
+{
+    std::string Path = ContentCachePath(Hashes);
+    if (Path.empty())
+        return false;
+
+    struct stat Buf;
+    bool Hit = (stat(Path.c_str(), &Buf) == 0 && S_ISREG(Buf.st_mode) &&
+                (Hashes.FileSize() == 0 ||
+                 (unsigned long long)Buf.st_size == Hashes.FileSize()));
+    if (Hit) {
+        unlink(Dest.c_str());
+        Hit = ContentCacheClone(Path, Dest);
+        // Drop corrupt entries, so that the fetched file replaces them
+        if (Hit && !Hashes.VerifyFile(Dest)) {
+            unlink(Dest.c_str());
+            unlink(Path.c_str());
+            Hit = false;
+        }
+    }
+
+    if (Acquire != 0 && PyObject_TypeCheck(Acquire, &PyAcquire_Type)) {
+        PyFetchStats &Stats = ((PyAcquireObject *)Acquire)->Stats;
+        Stats.Values[Hit ? PyFetchStats::CacheHits : PyFetchStats::CacheMisses]++;
+    }
+    return Hit;
+}
+
+void PyAcquire_ContentCacheStore(pkgAcquire *Fetcher)
+{
+    std::string Dir = _config->Find("Acquire::Content-Cache");
+    if (Dir.empty())
+        return;
+
+    for (pkgAcquire::ItemIterator I = Fetcher->ItemsBegin();
+         I != Fetcher->ItemsEnd(); ++I) {
+        pkgAcquire::Item *Item = *I;
+        // Index files are uncompressed after they are verified
+        if (dynamic_cast<pkgAcqArchive *>(Item) == 0 &&
+            dynamic_cast<pkgAcqFile *>(Item) == 0)
+            continue;
+        if (Item->Status != pkgAcquire::Item::StatDone || !Item->Complete)
+            continue;
+
+        std::string Path = ContentCachePath(Item->GetExpectedHashes());
+        struct stat Buf;
+        if (Path.empty() || stat(Path.c_str(), &Buf) == 0)
+            continue;
+
+        mkdir(Dir.c_str(), 0755);
+        mkdir(flNotFile(Path).c_str(), 0755);
+        // Other processes may store the same file at the same time
+        std::string Temp = Path + "." + std::to_string(getpid());
+        unlink(Temp.c_str());
+        if (ContentCacheClone(Item->DestFile, Temp) &&
+            rename(Temp.c_str(), Path.c_str()) != 0)
+            unlink(Temp.c_str());
+    }
+}
+
 static PyObject *PkgAcquireRun(PyObject *Self,PyObject *Args)
 {
+    PyAcquireObject *Obj = (PyAcquireObject *)Self;
     pkgAcquire *fetcher = GetCpp<pkgAcquire*>(Self);
 
     int pulseInterval = 500000;
     if (PyArg_ParseTuple(Args, "|i", &pulseInterval) == 0)
         return 0;
 
-    pkgAcquire::RunResult run = fetcher->Run(pulseInterval);
+    if (Obj->Running) {
+        PyErr_SetString(PyExc_RuntimeError, "Acquire.run() is already running");
+        return 0;
+    }
+
+    // Methods are started by Run() and read their options then
+    PyAcquireConfigScope scope(Self);
+    if (scope.Failed() || !PyAcquire_BeginRun(Obj->Options))
+        return 0;
+    pkgAcquire::RunResult run;
+    Obj->Running = true;
+    Obj->RunThread = PyThread_get_thread_ident();
+    if (!Obj->NoCallbacks) {
+        // PyFetchProgress releases the GIL itself between its callbacks
+        run = fetcher->Run(pulseInterval);
+    } else {
+        // Nothing calls into Python, let other threads run meanwhile
+        Py_BEGIN_ALLOW_THREADS
+        run = fetcher->Run(pulseInterval);
+        Py_END_ALLOW_THREADS
+    }
+    Obj->Running = false;
+
+    Py_BEGIN_ALLOW_THREADS
+    PyAcquire_ContentCacheStore(fetcher);
+    Py_END_ALLOW_THREADS
+    PyAcquire_EndRun();
 
     return HandleErrors(MkPyNumber(run));
 }
 
+static PyObject *PkgAcquireRunAsync(PyObject *Self,PyObject *Args)
+{
+    int pulseInterval = 500000;
+    if (PyArg_ParseTuple(Args, "|i", &pulseInterval) == 0)
+        return 0;
+
+    // Progress callbacks would be called from the executor thread
+    if (!((PyAcquireObject *)Self)->NoCallbacks) {
+        PyErr_SetString(PyExc_ValueError,
+                        "run_async() cannot be used with a progress object, "
+                        "use events=True instead");
+        return 0;
+    }
+
+    PyObject *asyncio = PyImport_ImportModule("asyncio");
+    if (asyncio == 0)
+        return 0;
+    PyObject *loop = PyObject_CallMethod(asyncio, "get_running_loop", "");
+    Py_DECREF(asyncio);
+    if (loop == 0)
+        return 0;
+    PyObject *run = PyObject_GetAttrString(Self, "run");
+    PyObject *future = 0;
+    if (run != 0)
+        future = PyObject_CallMethod(loop, "run_in_executor", "OON", Py_None,
+                                     run, MkPyNumber(pulseInterval));
+    Py_XDECREF(run);
+    Py_DECREF(loop);
+    return future;
+}
+
+static PyObject *PkgAcquireTime(double time)
+{
+    if (time < 0)
+        Py_RETURN_NONE;
+    return MkPyNumber(time);
+}
+
+static PyObject *PkgAcquireItemStats(PyObject *Self,PyObject *Args)
+{
+    if (PyArg_ParseTuple(Args, "") == 0)
+        return 0;
+    PyFetchRecorder *recorder = ((PyAcquireObject *)Self)->Recorder;
+    if (recorder == 0)
+        return PyList_New(0);
+
+    static const char *statuses[] = {"pending", "done", "failed", "hit"};
+    std::vector<PyFetchItemRecord> items;
+    {
+        std::lock_guard<std::mutex> guard(recorder->Lock);
+        items = recorder->Items;
+    }
+
+    PyObject *List = PyList_New(items.size());
+    if (List == 0)
+        return 0;
+    for (size_t i = 0; i < items.size(); i++) {
+        PyFetchItemRecord const &item = items[i];
+        ::URI uri(item.URI);
+        PyObject *Obj = Py_BuildValue("{s:N,s:N,s:N,s:N,s:s,s:N,s:N,s:N,s:N,s:N,s:I}",
+                                      "uri", CppPyString(item.URI),
+                                      "shortdesc", CppPyString(item.ShortDesc),
+                                      "method", CppPyString(uri.Access),
+                                      "host", CppPyString(uri.Host),
+                                      "status", statuses[item.Status],
+                                      "queued", PkgAcquireTime(item.Queued),
+                                      "started", PkgAcquireTime(item.Started),
+                                      "first_byte", PkgAcquireTime(item.FirstByte),
+                                      "finished", PkgAcquireTime(item.Finished),
+                                      "bytes", MkPyNumber(item.Bytes),
+                                      "retries", item.Fetches > 1 ? item.Fetches - 1 : 0);
+        if (Obj == 0) {
+            Py_DECREF(List);
+            return 0;
+        }
+        PyList_SET_ITEM(List, i, Obj);
+    }
+    return List;
+}
+
+static PyObject *PkgAcquirePollEvents(PyObject *Self,PyObject *Args)
+{
+    if (PyArg_ParseTuple(Args, "") == 0)
+        return 0;
+    PyFetchEvents *events = PkgAcquireEvents(Self);
+    if (events == 0) {
+        PyErr_SetString(PyExc_ValueError,
+                        "Acquire object was not created with events=True");
+        return 0;
+    }
+
+    std::deque<PyFetchEvents::Event> queue = events->Take();
+    PyObject *List = PyList_New(queue.size());
+    if (List == 0)
+        return 0;
+    Py_ssize_t i = 0;
+    for (auto const &ev : queue) {
+        PyObject *Obj = Py_BuildValue("(sNNNNNN)",
+                                      PyFetchEvents::TypeNames[ev.Type],
+                                      CppPyString(ev.URI),
+                                      CppPyString(ev.Description),
+                                      CppPyString(ev.ShortDesc),
+                                      MkPyNumber(ev.Current),
+                                      MkPyNumber(ev.Total),
+                                      CppPyString(ev.Message));
+        if (Obj == 0) {
+            Py_DECREF(List);
+            return 0;
+        }
+        PyList_SET_ITEM(List, i++, Obj);
+    }
+    return List;
+}
+
+
+void PyAcquire_ForgetItem(PyObject *Acquire, pkgAcquire::Item *Item)
+{
+    if (Acquire == 0 || !PyObject_TypeCheck(Acquire, &PyAcquire_Type))
+        return;
+    PyFetchRecorder *recorder = ((PyAcquireObject *)Acquire)->Recorder;
+    if (recorder != 0)
+        recorder->Forget(Item);
+}
+
+bool PyAcquire_CheckIdle(PyObject *Acquire)
+{
+    PyAcquireObject *Obj = (PyAcquireObject *)Acquire;
+    // The progress callbacks of run() may look at the fetcher
+    if (Obj->Running && Obj->RunThread != PyThread_get_thread_ident()) {
+        PyErr_SetString(PyExc_RuntimeError, "Acquire.run() is running");
+        return false;
+    }
+    return true;
+}
 
 static PyObject *PkgAcquireShutdown(PyObject *Self,PyObject *Args)
 {
     pkgAcquire *fetcher = GetCpp<pkgAcquire*>(Self);
     if (PyArg_ParseTuple(Args, "") == 0)
         return 0;
+    if (((PyAcquireObject *)Self)->Running) {
+        PyErr_SetString(PyExc_RuntimeError, "Acquire.run() is running");
+        return 0;
+    }
+    if (((PyAcquireObject *)Self)->Recorder != 0)
+        ((PyAcquireObject *)Self)->Recorder->ForgetAll();
     fetcher->Shutdown();
     Py_INCREF(Py_None);
     return HandleErrors(Py_None);
@@ -265,7 +653,32 @@ static PyMethodDef PkgAcquireMethods[] = {
      "RESULT_CONTINUE means that all items which where queued prior to\n"
      "calling run() have been fetched successfully or failed transiently.\n\n"
      "RESULT_CANCELLED means canceled by the progress class.\n\n"
-     "RESULT_FAILED means a generic failure."},
+     "RESULT_FAILED means a generic failure.\n\n"
+     "Unless a progress object was given, the GIL is released while\n"
+     "fetching."},
+    {"run_async",PkgAcquireRunAsync, METH_VARARGS,
+     "run_async([pulse_interval: int]) -> asyncio.Future\n\n"
+     "Run the fetcher in the default executor of the running event loop\n"
+     "and return a future for the result of run(). The event loop keeps\n"
+     "running meanwhile; with events=True, it can watch event_fd for\n"
+     "progress. Raises ValueError if a progress object is used."},
+    {"item_stats",PkgAcquireItemStats, METH_VARARGS,
+     "item_stats() -> list\n\n"
+     "Return a dict for each item seen while fetching, in the order they\n"
+     "were seen, with the keys 'uri', 'shortdesc', 'method', 'host',\n"
+     "'status' ('pending', 'done', 'failed' or 'hit'), 'queued',\n"
+     "'started', 'first_byte', 'finished' (seconds since the epoch, or\n"
+     "None), 'bytes' and 'retries'. The first byte is observed at pulse\n"
+     "granularity."},
+    {"poll_events",PkgAcquirePollEvents, METH_VARARGS,
+     "poll_events() -> list\n\n"
+     "Return the events queued since the last call, for an Acquire object\n"
+     "created with events=True. Each event is a tuple (type, uri,\n"
+     "description, shortdesc, current, total, message), where type is one\n"
+     "of 'start', 'fetch', 'ims_hit', 'done', 'fail', 'pulse', 'stop' and\n"
+     "'media_change'. Consecutive pulses are merged into the latest one.\n"
+     "This method may be called from another thread while run() is\n"
+     "fetching."},
     {"shutdown",PkgAcquireShutdown, METH_VARARGS,
      "shutdown()\n\n"
      "Shut the fetcher down, removing all items from it. Future access to\n"
@@ -280,20 +693,28 @@ static PyMethodDef PkgAcquireMethods[] = {
 #define fetcher (GetCpp<pkgAcquire*>(Self))
 static PyObject *PkgAcquireGetTotalNeeded(PyObject *Self,void*)
 {
+    if (!PyAcquire_CheckIdle(Self))
+        return 0;
     return MkPyNumber(fetcher->TotalNeeded());
 }
 static PyObject *PkgAcquireGetFetchNeeded(PyObject *Self,void*)
 {
+    if (!PyAcquire_CheckIdle(Self))
+        return 0;
     return MkPyNumber(fetcher->FetchNeeded());
 }
 static PyObject *PkgAcquireGetPartialPresent(PyObject *Self,void*)
 {
+    if (!PyAcquire_CheckIdle(Self))
+        return 0;
     return MkPyNumber(fetcher->PartialPresent());
 }
 #undef fetcher
 
 static PyObject *PkgAcquireGetWorkers(PyObject *self, void *closure)
 {
+    if (!PyAcquire_CheckIdle(self))
+        return 0;
     PyObject *List = PyList_New(0);
     pkgAcquire *Owner = GetCpp<pkgAcquire*>(self);
     PyObject *PyWorker = NULL;
@@ -307,6 +728,8 @@ static PyObject *PkgAcquireGetWorkers(PyObject *self, void *closure)
 }
 static PyObject *PkgAcquireGetItems(PyObject *Self,void*)
 {
+    if (!PyAcquire_CheckIdle(Self))
+        return 0;
     pkgAcquire *fetcher = GetCpp<pkgAcquire*>(Self);
     PyObject *List = PyList_New(0);
     PyObject *Obj;
@@ -319,7 +742,39 @@ static PyObject *PkgAcquireGetItems(PyObject *Self,void*)
     return List;
 }
 
+static PyObject *PkgAcquireGetEventFd(PyObject *Self,void*)
+{
+    PyFetchEvents *events = PkgAcquireEvents(Self);
+    return MkPyNumber(events != 0 ? events->Fd : -1);
+}
+
+static PyObject *PkgAcquireGetStats(PyObject *Self,void*)
+{
+    PyObject *view = PyMemoryView_FromObject(Self);
+    if (view == 0)
+        return 0;
+    PyObject *stats = PyObject_CallMethod(view, "cast", "s", "Q");
+    Py_DECREF(view);
+    return stats;
+}
+
+static int PkgAcquireGetBuffer(PyObject *Self, Py_buffer *view, int flags)
+{
+    PyFetchStats &stats = ((PyAcquireObject *)Self)->Stats;
+    return PyBuffer_FillInfo(view, Self, stats.Values, sizeof(stats.Values),
+                             1, flags);
+}
+
+static PyBufferProcs PkgAcquireBuffer = {
+    PkgAcquireGetBuffer,                 // bf_getbuffer
+    0,                                   // bf_releasebuffer
+};
+
 static PyGetSetDef PkgAcquireGetSet[] = {
+    {"event_fd",PkgAcquireGetEventFd,0,
+     "A file descriptor which is readable while events are pending, for\n"
+     "Acquire objects created with events=True, otherwise -1. It is reset\n"
+     "by poll_events()."},
     {"fetch_needed",PkgAcquireGetFetchNeeded,0,
      "The total amount of data to be fetched (number of bytes)."},
     {"items",PkgAcquireGetItems,0,
@@ -329,6 +784,11 @@ static PyGetSetDef PkgAcquireGetSet[] = {
      "A list of all active workers as apt_pkg.AcquireWorker objects."},
     {"partial_present",PkgAcquireGetPartialPresent,0,
      "The amount of data which is already available (number of bytes)."},
+    {"stats",PkgAcquireGetStats,0,
+     "A read-only memoryview of unsigned 64-bit integers, updated while\n"
+     "fetching without calling into Python. The fields are named by\n"
+     "STATS_FIELDS. The object itself supports the buffer protocol with\n"
+     "the same data, e.g. for ctypes."},
     {"total_needed",PkgAcquireGetTotalNeeded,0,
      "The amount of data that needs to fetched plus the amount of data\n"
      "which has already been fetched (number of bytes)."},
@@ -340,21 +800,95 @@ static PyObject *PkgAcquireNew(PyTypeObject *type,PyObject *Args,PyObject *kwds)
     pkgAcquire *fetcher;
 
     PyObject *pyFetchProgressInst = NULL;
-    char *kwlist[] = {"progress", 0};
-    if (PyArg_ParseTupleAndKeywords(Args,kwds,"|O",kwlist,&pyFetchProgressInst) == 0)
+    char events = 0;
+    double statsInterval = 0;
+    const char *queueMode = 0;
+    int maxParallel = 0;
+    long long rateLimit = 0;
+    char *kwlist[] = {"progress", "events", "stats_interval", "queue_mode",
+                      "max_parallel", "rate_limit", 0};
+    if (PyArg_ParseTupleAndKeywords(Args,kwds,"|ObdziL",kwlist,
+                                    &pyFetchProgressInst, &events,
+                                    &statsInterval, &queueMode, &maxParallel,
+                                    &rateLimit) == 0)
         return 0;
 
+    if (queueMode != 0 && strcasecmp(queueMode, "host") != 0 &&
+        strcasecmp(queueMode, "access") != 0) {
+        PyErr_Format(PyExc_ValueError,
+                     "queue_mode must be 'host' or 'access', not '%s'",
+                     queueMode);
+        return 0;
+    }
+    if (maxParallel < 0 || rateLimit < 0) {
+        PyErr_SetString(PyExc_ValueError,
+                        "max_parallel and rate_limit must not be negative");
+        return 0;
+    }
+
+    // Zero keeps the value of the configuration
+    PyAcquireOptions *options = 0;
+    if (queueMode != 0 || maxParallel != 0 || rateLimit != 0) {
+        options = new PyAcquireOptions();
+        if (queueMode != 0)
+            options->push_back(std::make_pair("Acquire::Queue-Mode",
+                                              std::string(queueMode)));
+        if (maxParallel != 0)
+            options->push_back(std::make_pair("Acquire::QueueHost::Limit",
+                                              std::to_string(maxParallel)));
+        // Dl-Limit is in KiB/s
+        for (const char *method : {"http", "https"})
+            if (rateLimit != 0)
+                options->push_back(std::make_pair(std::string("Acquire::") + method + "::Dl-Limit",
+                                                  std::to_string((rateLimit + 1023) / 1024)));
+    }
+
+    if (events && pyFetchProgressInst != NULL && pyFetchProgressInst != Py_None) {
+        PyErr_SetString(PyExc_ValueError,
+                        "progress and events=True are mutually exclusive");
+        return 0;
+    }
+
     PyFetchProgress *progress = 0;
-    if (pyFetchProgressInst != NULL) {
+    PyFetchEvents *eventlog = 0;
+    if (pyFetchProgressInst != NULL && pyFetchProgressInst != Py_None) {
         // FIXME: memleak?
-        progress = new PyFetchProgress();
+        if (statsInterval > 0)
+            progress = new PyFetchStructProgress(statsInterval);
+        else
+            progress = new PyFetchProgress();
         progress->setCallbackInst(pyFetchProgressInst);
+    } else {
+        // Keeps the statistics up to date, and queues events if asked to
+        eventlog = new PyFetchEvents(events);
     }
 
-    fetcher = new pkgAcquire();
-    fetcher->SetLog(progress);
+    {
+        // The queue mode is read by the constructor
+        PyAcquireConfigScope scope(options);
+        if (scope.Failed()) {
+            delete progress;
+            delete eventlog;
+            delete options;
+            return 0;
+        }
+        fetcher = new pkgAcquire();
+    }
+    if (eventlog != 0)
+        fetcher->SetLog(eventlog);
+    else
+        fetcher->SetLog(progress);
 
     PyObject *FetcherObj = CppPyObject_NEW<pkgAcquire*>(NULL, type, fetcher);
+    PyAcquireObject *AcquireObj = (PyAcquireObject *)FetcherObj;
+    AcquireObj->Events = eventlog;
+    AcquireObj->Options = options;
+    AcquireObj->NoCallbacks = (progress == 0);
+    AcquireObj->Recorder = new PyFetchRecorder(&AcquireObj->Stats);
+    if (progress != 0)
+        progress->Recorder = AcquireObj->Recorder;
+    else
+        eventlog->Recorder = AcquireObj->Recorder;
 
     if (progress != 0)
         progress->setPyAcquire(FetcherObj);
@@ -362,6 +896,18 @@ static PyObject *PkgAcquireNew(PyTypeObject *type,PyObject *Args,PyObject *kwds)
     return HandleErrors(FetcherObj);
 }
 
+static void PkgAcquireDealloc(PyObject *Self)
+{
+    // The fetcher may still report to the event log while shutting down
+    PyFetchEvents *events = ((PyAcquireObject *)Self)->Events;
+    PyFetchRecorder *recorder = ((PyAcquireObject *)Self)->Recorder;
+    PyAcquireOptions *options = ((PyAcquireObject *)Self)->Options;
+    CppDeallocPtr<pkgAcquire*>(Self);
+    delete events;
+    delete recorder;
+    delete options;
+}
+
 /**
  * Create a new apt_pkg.Acquire Python object from the pkgAcquire object.
  */
@@ -372,19 +918,36 @@ PyObject *PyAcquire_FromCpp(pkgAcquire *fetcher, bool Delete, PyObject *owner) {
 }
 
 static char *doc_PkgAcquire =
-    "Acquire([progress: apt.progress.base.AcquireProgress])\n\n"
+    "Acquire([progress: apt.progress.base.AcquireProgress, events: bool,\n"
+    "        stats_interval: float, queue_mode: str, max_parallel: int,\n"
+    "        rate_limit: int])\n\n"
     "Coordinate the retrieval of files via network or local file system\n"
     "(using 'copy:/path/to/file' style URIs). The optional argument\n"
     "'progress' takes an apt.progress.base.AcquireProgress object\n"
-    "which may report progress information.";
+    "which may report progress information.\n\n"
+    "If 'events' is True, no progress object is used. Instead, progress\n"
+    "is queued as events which can be read with poll_events(), also\n"
+    "from another thread while run() is fetching.\n\n"
+    "If 'stats_interval' is positive, 'progress' is used in struct mode:\n"
+    "only its start(), stop(), media_change() and, at most once per\n"
+    "'stats_interval' seconds, pulse() methods are called, and its\n"
+    "attributes are not updated. Read the 'stats' attribute of the\n"
+    "Acquire object instead.\n\n"
+    "The remaining arguments are process-wide fetch settings, which are\n"
+    "set in the configuration while this fetcher creates queues and runs.\n"
+    "No other fetcher can run meanwhile. 'queue_mode' is 'host' (one\n"
+    "queue per host) or 'access' (one queue per method). 'max_parallel'\n"
+    "limits the number of host queues, and thus connections, per method.\n"
+    "'rate_limit' limits the bandwidth of each HTTP(S) connection in\n"
+    "bytes per second.";
 
 PyTypeObject PyAcquire_Type = {
     PyVarObject_HEAD_INIT(&PyType_Type, 0)
     "apt_pkg.Acquire",                   // tp_name
-    sizeof(CppPyObject<pkgAcquire*>),    // tp_basicsize
+    sizeof(PyAcquireObject),             // tp_basicsize
     0,                                   // tp_itemsize
     // Methods
-    CppDeallocPtr<pkgAcquire*>,          // tp_dealloc
+    PkgAcquireDealloc,                   // tp_dealloc
     0,                                   // tp_print
     0,                                   // tp_getattr
     0,                                   // tp_setattr
@@ -398,7 +961,7 @@ PyTypeObject PyAcquire_Type = {
     0,                                   // tp_str
     _PyAptObject_getattro,               // tp_getattro
     0,                                   // tp_setattro
-    0,                                   // tp_as_buffer
+    &PkgAcquireBuffer,                   // tp_as_buffer
     (Py_TPFLAGS_DEFAULT |                // tp_flags
     Py_TPFLAGS_BASETYPE),
     doc_PkgAcquire,                      // tp_doc
@@ -24,7 +24,12 @@
 									/*}}}*/
 
 PyObject *PyAptError;
-static PyMethodDef *methods = 0;
+PyObject *PyAptHashString;
+PyObject *PyAptHashStringList;
+static PyMethodDef methods[] = {
+   {"scan_debs",reinterpret_cast<PyCFunction>(static_cast<PyCFunctionWithKeywords>(ScanDebs)),METH_VARARGS|METH_KEYWORDS,doc_ScanDebs},
+   {}
+};
 
 
 static const char *apt_inst_doc =
@@ -71,11 +76,23 @@ extern "C" void initapt_inst()
    if (PyAptError == NULL)
       INIT_ERROR;
 
+   PyAptHashString = PyObject_GetAttrString(apt_pkg, "HashString");
+   if (PyAptHashString == NULL)
+      INIT_ERROR;
+   PyAptHashStringList = PyObject_GetAttrString(apt_pkg, "HashStringList");
+   if (PyAptHashStringList == NULL)
+      INIT_ERROR;
+
    PyModule_AddObject(module,"Error",PyAptError);
    ADDTYPE(module,"ArMember",&PyArMember_Type);
    ADDTYPE(module,"ArArchive",&PyArArchive_Type);
    ADDTYPE(module,"DebFile",&PyDebFile_Type);
    ADDTYPE(module,"TarFile",&PyTarFile_Type);
    ADDTYPE(module,"TarMember",&PyTarMember_Type);
+   ADDTYPE(module,"TarMemberReader",&PyTarMemberReader_Type);
+   if (PyType_Ready(&PyArArchiveIter_Type) == -1)
+      INIT_ERROR;
+   if (PyType_Ready(&PyDebScan_Type) == -1)
+      INIT_ERROR;
    RETURN(module);
 }
@@ -12,18 +12,53 @@
 
 #include <Python.h>
 #include "generic.h"
+#include <apt-pkg/arfile.h>
 #include <apt-pkg/extracttar.h>
+#include <apt-pkg/hashes.h>
+#include <map>
+#include <string>
 
 
 extern PyTypeObject PyArMember_Type;
+extern PyTypeObject PyArArchiveIter_Type;
+extern PyTypeObject PyDebScan_Type;
 extern PyTypeObject PyArArchive_Type;
 extern PyTypeObject PyDebFile_Type;
 extern PyTypeObject PyTarFile_Type;
 extern PyTypeObject PyTarMember_Type;
+extern PyTypeObject PyTarMemberReader_Type;
+
+// apt_pkg.HashString and apt_pkg.HashStringList, imported from apt_pkg.
+extern PyObject *PyAptHashString;
+extern PyObject *PyAptHashStringList;
+
+// Find the member Name with any compression, and set Compressor for it.
+const ARArchive::Member *PyDebFile_FindTar(const ARArchive &AR,
+                                           const char *Name,
+                                           std::string &Compressor);
+
+// Functions
+extern const char *doc_ScanDebs;
+PyObject *ScanDebs(PyObject *Self,PyObject *Args,PyObject *kwds);
+
+class PyTarIndex;
 
 struct PyTarFileObject : public CppPyObject<ExtractTar*> {
     int min;
     FileFd Fd;
+    // Set while a reader returned by open_member() is using Fd.
+    bool busy;
+    // The member index used by build_index() and extractdata().
+    PyTarIndex *index;
 };
 
+// Hash the regular files of the TarFile with the given Hashes types,
+// mapping their names to the hashes. Sets a Python error on failure.
+bool PyTarFile_HashMembers(PyObject *tarfile, unsigned int types,
+                           std::map<std::string, HashStringList> &hashes);
+
+// Set up the index of a new TarFile reading 'max' bytes with 'comp'.
+void PyTarFile_InitIndex(PyTarFileObject *tarfile, const char *comp,
+                         unsigned long long max);
+
 #endif
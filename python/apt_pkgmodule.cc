@@ -11,6 +11,7 @@
 // Include Files							/*{{{*/
 #include "apt_pkgmodule.h"
 #include "generic.h"
+#include "progress.h"
 
 #include <apt-pkg/configuration.h>
 #include <apt-pkg/acquire-item.h>
@@ -669,6 +670,9 @@ static PyMethodDef methods[] =
    {"pkgsystem_unlock_inner",PkgSystemUnLockInner,METH_VARARGS,doc_PkgSystemUnLockInner},
    {"pkgsystem_is_locked",PkgSystemIsLocked,METH_VARARGS,doc_PkgSystemIsLocked},
 
+   // Processes
+   {"wait_child",reinterpret_cast<PyCFunction>(static_cast<PyCFunctionWithKeywords>(WaitChild)),METH_VARARGS|METH_KEYWORDS,doc_WaitChild},
+
    // Command line
    {"read_config_file",LoadConfig,METH_VARARGS,doc_LoadConfig},
    {"read_config_dir",LoadConfigDir,METH_VARARGS,doc_LoadConfigDir},
@@ -989,6 +993,13 @@ extern "C" void initapt_pkg()
                         MkPyNumber(pkgAcquire::Continue));
    PyDict_SetItemString(PyAcquire_Type.tp_dict, "RESULT_FAILED",
                         MkPyNumber(pkgAcquire::Failed));
+   {
+      PyObject *Fields = PyTuple_New(PyFetchStats::Count);
+      for (int I = 0; I != PyFetchStats::Count; I++)
+         PyTuple_SET_ITEM(Fields, I, CppPyString(PyFetchStats::Names[I]));
+      PyDict_SetItemString(PyAcquire_Type.tp_dict, "STATS_FIELDS", Fields);
+      Py_DECREF(Fields);
+   }
     // Dependency constants
    PyDict_SetItemString(PyDependency_Type.tp_dict, "TYPE_DEPENDS",
                         MkPyNumber(pkgCache::Dep::Depends));
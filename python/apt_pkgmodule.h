@@ -25,6 +25,9 @@
 #include <apt-pkg/cdrom.h>
 #include <apt-pkg/algorithms.h>
 #include <apt-pkg/metaindex.h>
+#include <string>
+#include <utility>
+#include <vector>
 #include "generic.h"
 
 // Configuration Stuff
@@ -40,6 +43,10 @@ PyObject *LoadConfigISC(PyObject *Self,PyObject *Args);
 PyObject *LoadConfigDir(PyObject *Self,PyObject *Args);
 PyObject *ParseCommandLine(PyObject *Self,PyObject *Args);
 
+// Install progress
+extern char *doc_WaitChild;
+PyObject *WaitChild(PyObject *Self,PyObject *Args,PyObject *kwds);
+
 // Tag File Stuff
 extern PyTypeObject PyTagSection_Type;
 extern PyTypeObject PyTagFile_Type;
@@ -103,6 +110,47 @@ extern char *doc_GetPkgAcqFile;
 PyObject *GetAcquire(PyObject *Self,PyObject *Args);
 PyObject *GetPkgAcqFile(PyObject *Self, PyObject *Args, PyObject *kwds);
 
+/* Per-fetcher overrides of configuration options, as passed to Acquire() */
+typedef std::vector<std::pair<std::string, std::string> > PyAcquireOptions;
+
+/* Sets the fetch settings of an Acquire object in _config while in scope,
+ * and restores the previous values afterwards. libapt-pkg reads them when
+ * the fetcher is created, when items are queued and when methods start, so
+ * they are process-wide. As Acquire.run() fetches without the GIL, they
+ * cannot be set while another fetcher runs; Failed() is then true and a
+ * RuntimeError is set. */
+class PyAcquireConfigScope {
+   std::vector<std::pair<std::string, std::string> > Saved;
+   std::vector<std::string> Unset;
+   bool Conflict;
+   void Apply(PyAcquireOptions const *Options);
+ public:
+   explicit PyAcquireConfigScope(PyAcquireOptions const *Options) : Conflict(false) { Apply(Options); }
+   explicit PyAcquireConfigScope(PyObject *Acquire);
+   ~PyAcquireConfigScope();
+   bool Failed() const { return Conflict; }
+};
+
+/* Counts a fetcher running without the GIL, for PyAcquireConfigScope.
+ * BeginRun fails with a RuntimeError while a fetcher with options runs. */
+bool PyAcquire_BeginRun(PyAcquireOptions const *Options);
+void PyAcquire_EndRun();
+
+/* The download cache named by Acquire::Content-Cache. Link links the file
+ * with the given hashes to Dest if it is cached, counting the hit or miss
+ * in the statistics of Acquire. Store adds the items fetched by Fetcher. */
+bool PyAcquire_ContentCacheLink(PyObject *Acquire, HashStringList const &Hashes,
+                                std::string const &Dest);
+void PyAcquire_ContentCacheStore(pkgAcquire *Fetcher);
+
+/* Raises a RuntimeError if another thread is in Acquire.run(), as the
+ * fetcher must not be used then. The progress callbacks of run() may. */
+bool PyAcquire_CheckIdle(PyObject *Acquire);
+
+/* Stops recording statistics for Item in Acquire before Item is deleted,
+ * so that a later item at the same address gets a record of its own. */
+void PyAcquire_ForgetItem(PyObject *Acquire, pkgAcquire::Item *Item);
+
 // packagemanager
 extern PyTypeObject PyPackageManager_Type;
 extern PyTypeObject PyPackageManager2_Type;
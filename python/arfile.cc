@@ -26,13 +26,16 @@
 #include <apt-pkg/error.h>
 #include <apt-pkg/aptconfiguration.h>
 #include <apt-pkg/configuration.h>
-#include <utime.h>
+#include <sys/sendfile.h>
 
 #include <unistd.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <fcntl.h>
-#include <array>
+#include <strings.h>
+#include <sys/mman.h>
+#include <algorithm>
+#include <memory>
 
 static PyObject *armember_get_name(PyObject *self, void *closure)
 {
@@ -139,8 +142,27 @@ public:
 
 struct PyArArchiveObject : public CppPyObject<PyARArchiveHack*> {
     FileFd Fd;
+    // The file mapped into memory with mmap=True, or NULL.
+    char *Map;
+    size_t MapSize;
 };
 
+// Return a memoryview of the member in the mapped archive.
+static PyObject *ararchive_view(PyArArchiveObject *self,
+                                const ARArchive::Member *member)
+{
+    if (member->Start + member->Size > self->MapSize)
+        return PyErr_Format(PyAptError, "Member '%s' is beyond the end of "
+                            "the file", member->Name.c_str());
+    PyObject *view = PyMemoryView_FromObject(self);
+    if (view == NULL)
+        return 0;
+    PyObject *slice = PySequence_GetSlice(view, member->Start,
+                                          member->Start + member->Size);
+    Py_DECREF(view);
+    return slice;
+}
+
 static const char *ararchive_getmember_doc =
     "getmember(name: str) -> ArMember\n\n"
     "Return an ArMember object for the member given by 'name'. Raise\n"
@@ -168,7 +190,9 @@ static PyObject *ararchive_getmember(PyArArchiveObject *self, PyObject *arg)
 static const char *ararchive_extractdata_doc =
     "extractdata(name: str) -> bytes\n\n"
     "Return the contents of the member, as a bytes object. Raise\n"
-    "LookupError if there is no ArMember with the given name.";
+    "LookupError if there is no ArMember with the given name.\n\n"
+    "If the archive was opened with mmap=True, return a read-only\n"
+    "memoryview of the member in the mapped file instead.";
 static PyObject *ararchive_extractdata(PyArArchiveObject *self, PyObject *args)
 {
     PyApt_Filename name;
@@ -179,6 +203,8 @@ static PyObject *ararchive_extractdata(PyArArchiveObject *self, PyObject *args)
         PyErr_Format(PyExc_LookupError,"No member named '%s'",name.path);
         return 0;
     }
+    if (self->Map != NULL)
+        return ararchive_view(self, member);
     if (member->Size > SIZE_MAX) {
         PyErr_Format(PyExc_MemoryError,
                      "Member '%s' is too large to read into memory",name.path);
@@ -210,18 +236,66 @@ class IntFD {
     inline ~IntFD() { close(fd); };
 };
 
+/*
+ * Copy size bytes at offset in infd to outfd. Members of an ar archive are
+ * stored uncompressed, so try to let the kernel copy them with
+ * copy_file_range() or sendfile() first, and fall back to copying them
+ * through a large buffer.
+ */
+static bool _copy_range(int infd, off_t offset, int outfd,
+                        unsigned long long size)
+{
+    while (size > 0) {
+        ssize_t res = copy_file_range(infd, &offset, outfd, NULL, size, 0);
+        if (res <= 0)
+            break;
+        size -= res;
+    }
+    while (size > 0) {
+        ssize_t res = sendfile(outfd, infd, &offset, size);
+        if (res <= 0)
+            break;
+        size -= res;
+    }
+    if (size == 0)
+        return true;
+
+    std::unique_ptr<char[]> buffer(new char[1 << 20]);
+    while (size > 0) {
+        ssize_t res = pread(infd, buffer.get(),
+                            std::min<unsigned long long>(size, 1 << 20),
+                            offset);
+        if (res < 0 && errno == EINTR)
+            continue;
+        if (res < 0)
+            return false;
+        if (res == 0) {
+            errno = EIO;
+            return false;
+        }
+        for (ssize_t done = 0; done < res;) {
+            ssize_t written = write(outfd, buffer.get() + done, res - done);
+            if (written < 0 && errno == EINTR)
+                continue;
+            if (written < 0)
+                return false;
+            done += written;
+        }
+        offset += res;
+        size -= res;
+    }
+    return true;
+}
+
 static PyObject *_extract(FileFd &Fd, const ARArchive::Member *member,
                           const char *dir)
 {
-    if (!Fd.Seek(member->Start))
-        return HandleErrors();
-
     std::string outfile_str = flCombine(dir,member->Name);
     char *outfile = (char*)outfile_str.c_str();
 
     // We are not using FileFd here, because we want to raise OSErrror with
     // the correct errno and filename. IntFD's are closed automatically.
-    IntFD outfd(open(outfile, O_NDELAY|O_WRONLY|O_CREAT|O_TRUNC|O_APPEND,
+    IntFD outfd(open(outfile, O_NDELAY|O_WRONLY|O_CREAT|O_TRUNC|O_CLOEXEC,
 		             member->Mode));
     if (outfd == -1)
         return PyErr_SetFromErrnoWithFilename(PyExc_OSError, outfile);
@@ -230,23 +304,22 @@ static PyObject *_extract(FileFd &Fd, const ARArchive::Member *member,
     if (fchown(outfd, member->UID, member->GID) != 0 && errno != EPERM)
         return PyErr_SetFromErrnoWithFilename(PyExc_OSError, outfile);
 
-    // Read 4 KiB from the file, until all of the file is read. Deallocated
-    // automatically when the function returns.
-    std::array<char, 4096> value;
-    unsigned long long size = member->Size;
-    unsigned long long read = 4096;
-    while (size > 0) {
-        if (size < read)
-            read = size;
-        if (!Fd.Read(value.data(), read, true))
-            return HandleErrors();
-        if (write(outfd, value.data(), read) != (signed long long)read)
-            return PyErr_SetFromErrnoWithFilename(PyExc_OSError, outfile);
-        size -= read;
-    }
-    utimbuf time = {static_cast<time_t>(member->MTime),
-                    static_cast<time_t>(member->MTime)};
-    if (utime(outfile,&time) == -1)
+    // Allocate the space at once, if the file system supports it.
+    if (member->Size > 0 && fallocate(outfd, 0, 0, member->Size) != 0 &&
+        errno != EOPNOTSUPP && errno != ENOSYS && errno != EINVAL)
+        return PyErr_SetFromErrnoWithFilename(PyExc_OSError, outfile);
+
+    bool res;
+    Py_BEGIN_ALLOW_THREADS
+    res = _copy_range(Fd.Fd(), member->Start, outfd, member->Size);
+    Py_END_ALLOW_THREADS
+    if (res == false)
+        return PyErr_SetFromErrnoWithFilename(PyExc_OSError, outfile);
+
+    struct timespec times[2];
+    times[0].tv_sec = times[1].tv_sec = member->MTime;
+    times[0].tv_nsec = times[1].tv_nsec = 0;
+    if (futimens(outfd, times) == -1)
         return PyErr_SetFromErrnoWithFilename(PyExc_OSError, outfile);
     Py_RETURN_TRUE;
 }
@@ -323,6 +396,7 @@ static PyObject *ararchive_gettar(PyArArchiveObject *self, PyObject *args)
     new (&tarfile->Fd) FileFd(self->Fd.Fd());
     tarfile->min = member->Start;
     tarfile->Object = new ExtractTar(self->Fd, member->Size, comp);
+    PyTarFile_InitIndex(tarfile, comp, member->Size);
     return HandleErrors(tarfile);
 }
 
@@ -359,14 +433,62 @@ static PyObject *ararchive_getnames(PyArArchiveObject *self)
     return list;
 }
 
-// Just run getmembers() and return an iterator over the list.
+// Iterate over the members, creating the ArMember objects as we go. The
+// iterator stores the next member, and the archive as its owner.
 static PyObject *ararchive_iter(PyArArchiveObject *self) {
-    PyObject *members = ararchive_getmembers(self);
-    PyObject *iter = PyObject_GetIter(members);
-    Py_DECREF(members);
+    CppPyObject<ARArchive::Member*> *iter;
+    iter = CppPyObject_NEW<ARArchive::Member*>(self,&PyArArchiveIter_Type);
+    iter->Object = self->Object->Members();
+    iter->NoDelete = true;
     return iter;
 }
 
+static PyObject *ararchiveiter_next(PyObject *self)
+{
+    ARArchive::Member *&member = GetCpp<ARArchive::Member*>(self);
+    if (member == NULL)
+        return 0;
+    CppPyObject<ARArchive::Member*> *ret;
+    ret = CppPyObject_NEW<ARArchive::Member*>(GetOwner<ARArchive::Member*>(self),
+                                              &PyArMember_Type);
+    ret->Object = member;
+    ret->NoDelete = true;
+    member = member->Next;
+    return ret;
+}
+
+PyTypeObject PyArArchiveIter_Type = {
+    PyVarObject_HEAD_INIT(&PyType_Type, 0)
+    "apt_inst.ArArchiveIterator",        // tp_name
+    sizeof(CppPyObject<ARArchive::Member*>),  // tp_basicsize
+    0,                                   // tp_itemsize
+    // Methods
+    CppDeallocPtr<ARArchive::Member*>, // tp_dealloc
+    0,                                   // tp_print
+    0,                                   // tp_getattr
+    0,                                   // tp_setattr
+    0,                                   // tp_compare
+    0,                                   // tp_repr
+    0,                                   // tp_as_number
+    0,                                   // tp_as_sequence
+    0,                                   // tp_as_mapping
+    0,                                   // tp_hash
+    0,                                   // tp_call
+    0,                                   // tp_str
+    0,                                   // tp_getattro
+    0,                                   // tp_setattro
+    0,                                   // tp_as_buffer
+    Py_TPFLAGS_DEFAULT |                 // tp_flags
+    Py_TPFLAGS_HAVE_GC,
+    "Iterator over the members of an ArArchive.", // tp_doc
+    CppTraverse<ARArchive::Member*>,// tp_traverse
+    CppClear<ARArchive::Member*>,   // tp_clear
+    0,                                   // tp_richcompare
+    0,                                   // tp_weaklistoffset
+    PyObject_SelfIter,                   // tp_iter
+    ararchiveiter_next,                  // tp_iternext
+};
+
 static PyMethodDef ararchive_methods[] = {
     {"getmember",(PyCFunction)ararchive_getmember,METH_O,
      ararchive_getmember_doc},
@@ -392,7 +514,10 @@ static PyObject *ararchive_new(PyTypeObject *type, PyObject *args,
     PyArArchiveObject *self;
     PyApt_Filename filename;
     int fileno;
-    if (PyArg_ParseTuple(args,"O:__new__",&file) == 0)
+    char use_mmap = 0;
+    char *kwlist[] = {"file", "mmap", NULL};
+    if (PyArg_ParseTupleAndKeywords(args, kwds, "O|b:__new__", kwlist,
+                                    &file, &use_mmap) == 0)
         return 0;
 
     // We receive a filename.
@@ -413,15 +538,51 @@ static PyObject *ararchive_new(PyTypeObject *type, PyObject *args,
     self->Object = (PyARArchiveHack*)new ARArchive(self->Fd);
     if (_error->PendingError() == true)
         return HandleErrors();
+
+    if (use_mmap) {
+        struct stat St;
+        void *map = MAP_FAILED;
+        if (fstat(self->Fd.Fd(), &St) == -1)
+            _error->Errno("fstat", "Could not stat %s", self->Fd.Name().c_str());
+        else if ((map = mmap(NULL, St.st_size, PROT_READ, MAP_SHARED,
+                             self->Fd.Fd(), 0)) == MAP_FAILED)
+            _error->Errno("mmap", "Could not map %s", self->Fd.Name().c_str());
+        if (map == MAP_FAILED)
+            return HandleErrors(self);
+        self->Map = (char *) map;
+        self->MapSize = St.st_size;
+    }
     return self;
 }
 
 static void ararchive_dealloc(PyObject *self)
 {
-    ((PyArArchiveObject *)(self))->Fd.~FileFd();
+    PyArArchiveObject *archive = (PyArArchiveObject *)self;
+    if (archive->Map != NULL)
+        munmap(archive->Map, archive->MapSize);
+    archive->Fd.~FileFd();
     CppDeallocPtr<ARArchive*>(self);
 }
 
+// Export the mapped file, for the memoryviews returned by extractdata().
+static int ararchive_getbuffer(PyObject *self, Py_buffer *view, int flags)
+{
+    PyArArchiveObject *archive = (PyArArchiveObject *)self;
+    if (archive->Map == NULL) {
+        view->obj = NULL;
+        PyErr_SetString(PyExc_BufferError,
+                        "The archive was not opened with mmap=True");
+        return -1;
+    }
+    return PyBuffer_FillInfo(view, self, archive->Map, archive->MapSize, 1,
+                             flags);
+}
+
+static PyBufferProcs ararchive_as_buffer = {
+    ararchive_getbuffer,                 // bf_getbuffer
+    0                                    // bf_releasebuffer
+};
+
 // Return bool or -1 (exception).
 static int ararchive_contains(PyObject *self, PyObject *arg)
 {
@@ -440,13 +601,15 @@ static PyMappingMethods ararchive_as_mapping = {
 };
 
 static const char *ararchive_doc =
-    "ArArchive(file: str/int/file)\n\n"
+    "ArArchive(file: str/int/file[, mmap: bool = False])\n\n"
     "Represent an archive in the 4.4 BSD ar format,\n"
     "which is used for e.g. deb packages.\n\n"
     "The parameter 'file' may be a string specifying the path of a file, or\n"
     "a file-like object providing the fileno() method. It may also be an int\n"
     "specifying a file descriptor (returned by e.g. os.open()).\n"
-    "The recommended way of using it is to pass in the path to the file.";
+    "The recommended way of using it is to pass in the path to the file.\n\n"
+    "If 'mmap' is True, the file is mapped into memory and extractdata()\n"
+    "returns memoryviews of the members instead of copying them.";
 
 PyTypeObject PyArArchive_Type = {
     PyVarObject_HEAD_INIT(&PyType_Type, 0)
@@ -468,7 +631,7 @@ PyTypeObject PyArArchive_Type = {
     0,                                   // tp_str
     0,                                   // tp_getattro
     0,                                   // tp_setattro
-    0,                                   // tp_as_buffer
+    &ararchive_as_buffer,                // tp_as_buffer
     Py_TPFLAGS_DEFAULT |                 // tp_flags
     Py_TPFLAGS_HAVE_GC,
     ararchive_doc,                       // tp_doc
@@ -532,18 +695,19 @@ static PyObject *_gettar(PyDebFileObject *self, const ARArchive::Member *m,
     new (&tarfile->Fd) FileFd(self->Fd.Fd());
     tarfile->min = m->Start;
     tarfile->Object = new ExtractTar(self->Fd, m->Size, comp);
+    PyTarFile_InitIndex(tarfile, comp, m->Size);
     return tarfile;
 }
 
 /*
  * Mostly copy-paste from APT
  */
-static PyObject *debfile_get_tar(PyDebFileObject *self, const char *Name)
+const ARArchive::Member *PyDebFile_FindTar(const ARArchive &AR,
+                                           const char *Name,
+                                           std::string &Compressor)
 {
     // Get the archive member
     const ARArchive::Member *Member = NULL;
-    const ARArchive &AR = *self->Object;
-    std::string Compressor;
 
     std::vector<APT::Configuration::Compressor> compressor =
         APT::Configuration::getCompressors();
@@ -569,8 +733,17 @@ static PyObject *debfile_get_tar(PyDebFileObject *self, const char *Name)
         ext.append("}");
         _error->Error(("Internal error, could not locate member %s"),
                       ext.c_str());
-        return HandleErrors();
     }
+    return Member;
+}
+
+static PyObject *debfile_get_tar(PyDebFileObject *self, const char *Name)
+{
+    std::string Compressor;
+    const ARArchive::Member *Member = PyDebFile_FindTar(*self->Object, Name,
+                                                        Compressor);
+    if (Member == NULL)
+        return HandleErrors();
 
     return _gettar(self, Member, Compressor.c_str());
 }
@@ -596,6 +769,11 @@ static PyObject *debfile_new(PyTypeObject *type, PyObject *args, PyObject *kwds)
         return PyErr_Format(PyAptError, "No debian archive, missing %s",
                             "debian-binary");
 
+    if (self->Map != NULL && member->Start + member->Size <= self->MapSize) {
+        self->debian_binary = PyBytes_FromStringAndSize(self->Map + member->Start,
+                                                        member->Size);
+        return self;
+    }
     if (!self->Fd.Seek(member->Start))
         return HandleErrors();
 
@@ -628,6 +806,78 @@ static void debfile_dealloc(PyObject *self) {
     PyArArchive_Type.tp_dealloc(self);
 }
 
+static const char *debfile_extract_control_doc =
+    "extract_control([names: list]) -> dict\n\n"
+    "Return a dict mapping the names of the members of the control archive\n"
+    "to their contents, as bytes. This is the same as calling\n"
+    "control.extract_members(names).";
+static PyObject *debfile_extract_control(PyDebFileObject *self, PyObject *args)
+{
+    PyObject *names = Py_None;
+    if (PyArg_ParseTuple(args, "|O:extract_control", &names) == 0)
+        return 0;
+    return PyObject_CallMethod(self->control, "extract_members", "(O)", names);
+}
+
+static const char *debfile_verify_md5sums_doc =
+    "verify_md5sums() -> list\n\n"
+    "Check the regular files of the data archive against the md5sums file\n"
+    "of the control archive, and return the names of the files which are\n"
+    "missing or have a different MD5 sum, in the order of md5sums. Raise\n"
+    "LookupError if the package has no md5sums file.";
+static PyObject *debfile_verify_md5sums(PyDebFileObject *self, PyObject *args)
+{
+    PyObject *md5sums = PyObject_CallMethod(self->control, "extractdata",
+                                            "(s)", "md5sums");
+    if (md5sums == NULL)
+        return 0;
+    std::string content(PyBytes_AS_STRING(md5sums), PyBytes_GET_SIZE(md5sums));
+    Py_DECREF(md5sums);
+
+    std::map<std::string, HashStringList> hashes;
+    if (PyTarFile_HashMembers(self->data, Hashes::MD5SUM, hashes) == false)
+        return 0;
+
+    PyObject *failed = PyList_New(0);
+    std::string::size_type start = 0;
+    while (failed != NULL && start < content.size()) {
+        std::string::size_type end = content.find('\n', start);
+        if (end == std::string::npos)
+            end = content.size();
+        // Each line is "<md5sum>  <path>".
+        std::string line = content.substr(start, end - start);
+        start = end + 1;
+        std::string::size_type space = line.find_first_of(" \t");
+        std::string::size_type path = line.find_first_not_of(" \t", space);
+        if (space == std::string::npos || path == std::string::npos)
+            continue;
+        std::string sum = line.substr(0, space);
+        std::string name = line.substr(path);
+        if (name.compare(0, 2, "./") == 0)
+            name.erase(0, 2);
+
+        auto member = hashes.find(name);
+        const HashString *md5 = NULL;
+        if (member != hashes.end())
+            md5 = member->second.find("MD5Sum");
+        if (md5 != NULL && strcasecmp(md5->HashValue().c_str(), sum.c_str()) == 0)
+            continue;
+        PyObject *py_name = CppPyPath(name);
+        if (py_name == NULL || PyList_Append(failed, py_name) == -1)
+            Py_CLEAR(failed);
+        Py_XDECREF(py_name);
+    }
+    return failed;
+}
+
+static PyMethodDef debfile_methods[] = {
+    {"extract_control",(PyCFunction)debfile_extract_control,METH_VARARGS,
+     debfile_extract_control_doc},
+    {"verify_md5sums",(PyCFunction)debfile_verify_md5sums,METH_NOARGS,
+     debfile_verify_md5sums_doc},
+    {NULL}
+};
+
 static PyGetSetDef debfile_getset[] = {
     {"control",(getter)debfile_get_control,0,
      "The TarFile object associated with the control.tar.gz member."},
@@ -641,7 +891,7 @@ static PyGetSetDef debfile_getset[] = {
 };
 
 static const char *debfile_doc =
-    "DebFile(file: str/int/file)\n\n"
+    "DebFile(file: str/int/file[, mmap: bool = False])\n\n"
     "A DebFile object represents a file in the .deb package format.\n\n"
     "The parameter 'file' may be a string specifying the path of a file, or\n"
     "a file-like object providing the fileno() method. It may also be an int\n"
@@ -650,7 +900,7 @@ static const char *debfile_doc =
     "It differs from ArArchive by providing the members 'control', 'data'\n"
     "and 'version' for accessing the control.tar.gz, data.tar.$compression \n"
     "(all apt compression methods are supported), and debian-binary members \n"
-    "in the archive.";
+    "in the archive. The parameter 'mmap' is the same as for ArArchive.";
 
 PyTypeObject PyDebFile_Type = {
     PyVarObject_HEAD_INIT(&PyType_Type, 0)
@@ -682,7 +932,7 @@ PyTypeObject PyDebFile_Type = {
     0,                                 // tp_weaklistoffset
     0,                                 // tp_iter
     0,                                 // tp_iternext
-    0,                                 // tp_methods
+    debfile_methods,                   // tp_methods
     0,                                 // tp_members
     debfile_getset,                    // tp_getset
     &PyArArchive_Type,                 // tp_base
@@ -21,8 +21,19 @@
 #include <apt-pkg/sourcelist.h>
 #include <apt-pkg/algorithms.h>
 #include <apt-pkg/update.h>
+#include <apt-pkg/pkgrecords.h>
+#include <apt-pkg/fileutl.h>
+#include <apt-pkg/strutl.h>
 
 #include <Python.h>
+#include <algorithm>
+#include <exception>
+#include <fstream>
+#include <stdint.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <unordered_map>
+#include <vector>
 #include "progress.h"
 
 class pkgSourceList;
@@ -130,6 +141,12 @@ static PyObject *CreateProvides(PyObject *Owner,pkgCache::PrvIterator I)
 // Cache Class								/*{{{*/
 // ---------------------------------------------------------------------
 
+/* Fetch status for updates without a progress object. */
+struct PyFetchQuiet : public pkgAcquireStatus
+{
+   virtual bool MediaChange(std::string, std::string) { return false; }
+};
+
 static const char *cache_update_doc =
     "update(progress, sources: SourceList, pulse_interval: int) -> bool\n\n"
     "Update the index files used by the cache. A call to this method\n"
@@ -138,6 +155,8 @@ static const char *cache_update_doc =
     "The parameter 'progress' can be used to specify an\n"
     "apt.progress.base.AcquireProgress() object , which will report\n"
     "progress information while the index files are being fetched.\n"
+    "If it is None, no progress is reported and the GIL is released\n"
+    "while fetching.\n"
     "The parameter 'sources', if provided, is an apt_pkg.SourcesList\n"
     "object listing the remote repositories to be used.\n"
     "The 'pulse_interval' parameter indicates how long (in microseconds)\n"
@@ -152,19 +171,310 @@ static PyObject *PkgCacheUpdate(PyObject *Self,PyObject *Args)
             &PySourceList_Type, &pySourcesList, &pulseInterval) == 0)
       return 0;
 
-   PyFetchProgress progress;
-   progress.setCallbackInst(pyFetchProgressInst);
    pkgSourceList *source = GetCpp<pkgSourceList*>(pySourcesList);
-   bool res = ListUpdate(progress, *source, pulseInterval);
+   if (PyAcquire_BeginRun(0) == false)
+      return 0;
+   bool res;
+   if (pyFetchProgressInst == Py_None) {
+      PyFetchQuiet progress;
+      Py_BEGIN_ALLOW_THREADS
+      res = ListUpdate(progress, *source, pulseInterval);
+      Py_END_ALLOW_THREADS
+   } else {
+      PyFetchProgress progress;
+      progress.setCallbackInst(pyFetchProgressInst);
+      res = ListUpdate(progress, *source, pulseInterval);
+   }
+   PyAcquire_EndRun();
 
    PyObject *PyRes = PyBool_FromLong(res);
    return HandleErrors(PyRes);
 }
 
+// SourceMap - Binary version to source package mapping		/*{{{*/
+// ---------------------------------------------------------------------
+/* Source names and versions are interned once; Source and SourceVer are
+   indexed by version ID and point into them, -1 meaning unknown. The map
+   is built in a single pass over the records in file and offset order,
+   and saved as pkgcache.bin.srcmap keyed by the cache's index files, so
+   that apt clean removes it along with the cache. */
+struct SourceMap
+{
+   std::vector<std::string> Names;
+   std::vector<std::string> Versions;
+   std::vector<int> Source;
+   std::vector<int> SourceVer;
+
+   static std::string Key(pkgCache &Cache);
+   bool Build(pkgCache &Cache);
+   bool Load(std::string const &Path, std::string const &Key,
+	     unsigned long VersionCount);
+   bool Save(std::string const &Path, std::string const &Key) const;
+};
+
+std::string SourceMap::Key(pkgCache &Cache)
+{
+   pkgCache::Header const *Head = Cache.HeaderP;
+   std::string Key;
+   strprintf(Key, "%lu %lu %lu %lu %lu\n", (unsigned long)Head->PackageCount,
+	     (unsigned long)Head->VersionCount, (unsigned long)Head->GroupCount,
+	     (unsigned long)Head->DependsCount, (unsigned long)Head->ProvidesCount);
+   for (pkgCache::PkgFileIterator File = Cache.FileBegin(); File.end() == false; ++File)
+   {
+      std::string Line;
+      strprintf(Line, "%s %lu %llu\n", File.FileName() == 0 ? "" : File.FileName(),
+		(unsigned long)File->mtime, (unsigned long long)File->Size);
+      Key += Line;
+   }
+   return Key;
+}
+
+bool SourceMap::Build(pkgCache &Cache)
+{
+   struct Entry {
+      pkgCache::VerFileIterator File;
+      pkgCache::VerIterator Ver;
+   };
+   std::vector<Entry> Entries;
+   Entries.reserve(Cache.HeaderP->VersionCount);
+   for (pkgCache::PkgIterator Pkg = Cache.PkgBegin(); Pkg.end() == false; ++Pkg)
+      for (pkgCache::VerIterator Ver = Pkg.VersionList(); Ver.end() == false; ++Ver)
+	 if (Ver.FileList().end() == false)
+	    Entries.push_back(Entry{Ver.FileList(), Ver});
+
+   // Read each index file front to back instead of seeking around
+   std::stable_sort(Entries.begin(), Entries.end(), [](Entry const &A, Entry const &B) {
+      if (A.File->File != B.File->File)
+	 return A.File->File < B.File->File;
+      return A.File->Offset < B.File->Offset;
+   });
+
+   Source.assign(Cache.HeaderP->VersionCount, -1);
+   SourceVer.assign(Cache.HeaderP->VersionCount, -1);
+   std::unordered_map<std::string, int> NameIds;
+   std::unordered_map<std::string, int> VersionIds;
+   pkgRecords Records(Cache);
+   if (_error->PendingError() == true)
+      return false;
+   for (auto const &E : Entries)
+   {
+      pkgRecords::Parser &Parser = Records.Lookup(E.File);
+      std::string Name = Parser.SourcePkg();
+      if (Name.empty() == true)
+	 Name = E.Ver.ParentPkg().Name();
+      std::string Version = Parser.SourceVer();
+      if (Version.empty() == true)
+	 Version = E.Ver.VerStr();
+
+      auto N = NameIds.emplace(Name, Names.size());
+      if (N.second == true)
+	 Names.push_back(Name);
+      auto V = VersionIds.emplace(Version, Versions.size());
+      if (V.second == true)
+	 Versions.push_back(Version);
+      Source[E.Ver->ID] = N.first->second;
+      SourceVer[E.Ver->ID] = V.first->second;
+   }
+   return _error->PendingError() == false;
+}
+
+// The number of bytes left in a file of the given size.
+static uint64_t SourceMapLeft(std::istream &In, uint64_t Size)
+{
+   std::streamoff const Pos = In.tellg();
+   if (Pos < 0 || (uint64_t)Pos > Size)
+      return 0;
+   return Size - Pos;
+}
+
+/* Counts and lengths are checked against the bytes left in the file before
+   anything is allocated for them, so a corrupt map is just not loaded. */
+static bool SourceMapReadStrings(std::istream &In, uint64_t Size,
+				 std::vector<std::string> &Out)
+{
+   uint32_t Count;
+   if (!In.read((char *)&Count, sizeof(Count)) ||
+       (uint64_t)Count * sizeof(uint32_t) > SourceMapLeft(In, Size))
+      return false;
+   Out.resize(Count);
+   for (auto &Str : Out)
+   {
+      uint32_t Len;
+      if (!In.read((char *)&Len, sizeof(Len)) || Len > SourceMapLeft(In, Size))
+	 return false;
+      Str.resize(Len);
+      if (Len != 0 && !In.read(&Str[0], Len))
+	 return false;
+   }
+   return true;
+}
+
+static void SourceMapWriteStrings(std::ostream &Out, std::vector<std::string> const &In)
+{
+   uint32_t Count = In.size();
+   Out.write((char const *)&Count, sizeof(Count));
+   for (auto const &Str : In)
+   {
+      uint32_t Len = Str.size();
+      Out.write((char const *)&Len, sizeof(Len));
+      Out.write(Str.data(), Len);
+   }
+}
+
+static char const SourceMapMagic[8] = {'P','Y','S','R','C','M','P','1'};
+
+bool SourceMap::Load(std::string const &Path, std::string const &Key,
+		     unsigned long VersionCount)
+{
+   std::ifstream In(Path, std::ios::binary | std::ios::ate);
+   std::streamoff const End = In.tellg();
+   if (!In || End < 0 || !In.seekg(0))
+      return false;
+   uint64_t const Size = End;
+   char Magic[sizeof(SourceMapMagic)];
+   if (!In.read(Magic, sizeof(Magic)) ||
+       std::equal(Magic, Magic + sizeof(Magic), SourceMapMagic) == false)
+      return false;
+
+   std::vector<std::string> Stored;
+   if (SourceMapReadStrings(In, Size, Stored) == false || Stored.size() != 1 ||
+       Stored[0] != Key)
+      return false;
+   if (SourceMapReadStrings(In, Size, Names) == false ||
+       SourceMapReadStrings(In, Size, Versions) == false)
+      return false;
+
+   uint32_t Count;
+   if (!In.read((char *)&Count, sizeof(Count)) || Count != VersionCount ||
+       (uint64_t)Count * 2 * sizeof(int) > SourceMapLeft(In, Size))
+      return false;
+   Source.resize(Count);
+   SourceVer.resize(Count);
+   if (!In.read((char *)Source.data(), Count * sizeof(int)) ||
+       !In.read((char *)SourceVer.data(), Count * sizeof(int)))
+      return false;
+
+   for (uint32_t I = 0; I != Count; I++)
+      if (Source[I] < -1 || Source[I] >= (int)Names.size() ||
+	  SourceVer[I] < -1 || SourceVer[I] >= (int)Versions.size())
+	 return false;
+   return true;
+}
+
+bool SourceMap::Save(std::string const &Path, std::string const &Key) const
+{
+   std::string const Tmp = Path + ".new";
+   {
+      std::ofstream Out(Tmp, std::ios::binary | std::ios::trunc);
+      if (!Out)
+	 return false;
+      Out.write(SourceMapMagic, sizeof(SourceMapMagic));
+      SourceMapWriteStrings(Out, std::vector<std::string>(1, Key));
+      SourceMapWriteStrings(Out, Names);
+      SourceMapWriteStrings(Out, Versions);
+      uint32_t Count = Source.size();
+      Out.write((char const *)&Count, sizeof(Count));
+      Out.write((char const *)Source.data(), Count * sizeof(int));
+      Out.write((char const *)SourceVer.data(), Count * sizeof(int));
+      if (!Out.flush())
+      {
+	 Out.close();
+	 unlink(Tmp.c_str());
+	 return false;
+      }
+   }
+   if (rename(Tmp.c_str(), Path.c_str()) != 0)
+   {
+      unlink(Tmp.c_str());
+      return false;
+   }
+   return true;
+}
+
+static PyObject *StringVectorToList(std::vector<std::string> const &Strings)
+{
+   PyObject *List = PyList_New(Strings.size());
+   if (List == 0)
+      return 0;
+   for (size_t I = 0; I != Strings.size(); I++)
+      PyList_SET_ITEM(List, I, CppPyString(Strings[I]));
+   return List;
+}
+
+static const char *cache_source_map_doc =
+    "source_map() -> dict\n\n"
+    "Return the mapping between binary versions and source packages as\n"
+    "a dict of compact arrays:\n\n"
+    " - 'sources': list of source package names\n"
+    " - 'source': array of ints indexed by Version.id, giving the index\n"
+    "   into 'sources' (-1 if unknown)\n"
+    " - 'source_versions': list of source version strings\n"
+    " - 'source_version': array of ints indexed by Version.id, giving the\n"
+    "   index into 'source_versions' (-1 if unknown)\n"
+    " - 'offsets', 'versions': the reverse direction; the IDs of the\n"
+    "   binary versions built from sources[i] are\n"
+    "   versions[offsets[i]:offsets[i + 1]]\n\n"
+    "The map is read from the Source fields of the index files in one\n"
+    "pass and stored next to the binary cache file, so that it only\n"
+    "has to be rebuilt when the index files change.";
+static PyObject *PkgCacheSourceMap(PyObject *Self,PyObject *Args)
+{
+   if (PyArg_ParseTuple(Args, "") == 0)
+      return 0;
+   pkgCache *Cache = GetCpp<pkgCache *>(Self);
+
+   SourceMap Map;
+   std::string const Key = SourceMap::Key(*Cache);
+   std::string Path = _config->FindFile("Dir::Cache::pkgcache");
+   if (Path.empty() == false)
+      Path += ".srcmap";
+   bool Loaded = false;
+   if (Path.empty() == false)
+   {
+      // Anything going wrong while loading just means a rebuild
+      try {
+	 Loaded = Map.Load(Path, Key, Cache->HeaderP->VersionCount);
+      } catch (std::exception const &) {
+	 Loaded = false;
+      }
+   }
+   if (Loaded == false)
+   {
+      Map = SourceMap();
+      if (Map.Build(*Cache) == false)
+	 return HandleErrors();
+      // The stored map is only an accelerator, failing to write is fine
+      if (Path.empty() == false)
+	 Map.Save(Path, Key);
+   }
+
+   // Group the binary versions by source for the reverse direction
+   std::vector<int> Offsets(Map.Names.size() + 1, 0);
+   for (int Src : Map.Source)
+      if (Src >= 0)
+	 Offsets[Src + 1]++;
+   for (size_t I = 1; I < Offsets.size(); I++)
+      Offsets[I] += Offsets[I - 1];
+   std::vector<int> Versions(Offsets.back());
+   std::vector<int> Fill(Offsets.begin(), Offsets.end() - 1);
+   for (size_t Id = 0; Id != Map.Source.size(); Id++)
+      if (Map.Source[Id] >= 0)
+	 Versions[Fill[Map.Source[Id]]++] = Id;
+
+   return HandleErrors(Py_BuildValue("{s:N,s:N,s:N,s:N,s:N,s:N}",
+				     "sources", StringVectorToList(Map.Names),
+				     "source", IntVectorToArray(Map.Source),
+				     "source_versions", StringVectorToList(Map.Versions),
+				     "source_version", IntVectorToArray(Map.SourceVer),
+				     "offsets", IntVectorToArray(Offsets),
+				     "versions", IntVectorToArray(Versions)));
+}
+									/*}}}*/
 
 static PyMethodDef PkgCacheMethods[] =
 {
    {"update",PkgCacheUpdate,METH_VARARGS,cache_update_doc},
+   {"source_map",PkgCacheSourceMap,METH_VARARGS,cache_source_map_doc},
    {}
 };
 
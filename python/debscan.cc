@@ -0,0 +1,457 @@
+/*
+ * debscan.cc - Scan many .deb files in parallel.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ */
+
+#include <Python.h>
+#include "generic.h"
+#include "apt_instmodule.h"
+#include <apt-pkg/arfile.h>
+#include <apt-pkg/aptconfiguration.h>
+#include <apt-pkg/dirstream.h>
+#include <apt-pkg/error.h>
+#include <apt-pkg/extracttar.h>
+#include <apt-pkg/fileutl.h>
+
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+// The result of scanning a single package.
+struct DebScanResult
+{
+    std::string Path;
+    // The error messages, if the package could not be scanned.
+    std::string Error;
+    // The requested members of the control archive which were found.
+    std::map<std::string, std::string> Control;
+    // The names of the members of the data archive.
+    std::vector<std::string> FileList;
+};
+
+/**
+ * Scans packages in worker threads, which do not hold the GIL.
+ *
+ * Results are queued in the order in which the packages are finished. At
+ * most MaxQueued results are kept; the workers wait when the queue is full,
+ * so a slow consumer does not cause the results to pile up in memory.
+ */
+class DebScan
+{
+public:
+    std::vector<std::string> Paths;
+    // What to return for each package, in order.
+    std::vector<std::string> Want;
+    // The requested control members, and whether the file list is wanted.
+    std::set<std::string> Control;
+    bool FileList;
+
+    std::mutex Lock;
+    std::condition_variable Cond;
+    std::vector<std::thread> Workers;
+    std::deque<DebScanResult> Results;
+    size_t MaxQueued;
+    // The index of the next path to scan, and the workers still running.
+    size_t Next;
+    size_t Running;
+    bool Cancelled;
+
+    void Work();
+    bool Pop(DebScanResult &Res);
+    void Stop();
+
+    DebScan() : FileList(false), MaxQueued(0), Next(0), Running(0),
+                Cancelled(false) {}
+    ~DebScan() { Stop(); }
+};
+
+// Read the requested members of the control archive into strings.
+class DebScanControlStream : public pkgDirStream
+{
+    std::set<std::string> Wanted;
+    std::map<std::string, std::string> &Control;
+    std::string *Current;
+
+public:
+    // Set when Go() was stopped because all members were read.
+    bool Complete;
+
+    virtual bool DoItem(Item &Itm,int &Fd)
+    {
+        Fd = -1;
+        Current = NULL;
+        if (Wanted.count(Itm.Name) == 0)
+            return true;
+        // The size comes from the package, do not trust it blindly
+        if (Itm.Size > PY_SSIZE_T_MAX)
+            return _error->Error("The member %s was too large to read into memory",
+                                 Itm.Name);
+        Current = &Control[Itm.Name];
+        Current->resize(Itm.Size);
+        Fd = -2;
+        return true;
+    }
+#if (APT_PKG_MAJOR >= 5)
+    virtual bool Process(Item &Itm,const unsigned char *Data,
+                         unsigned long long Size,unsigned long long Pos)
+#else
+    virtual bool Process(Item &Itm,const unsigned char *Data,
+                         unsigned long Size,unsigned long Pos)
+#endif
+    {
+        Current->replace(Pos, Size, (const char *) Data, Size);
+        return true;
+    }
+    virtual bool FinishedFile(Item &Itm,int Fd)
+    {
+        if (Current == NULL)
+            return true;
+        Wanted.erase(Itm.Name);
+        Complete = Wanted.empty();
+        return Complete == false;
+    }
+
+    DebScanControlStream(std::set<std::string> const &Wanted,
+                         std::map<std::string, std::string> &Control) :
+        Wanted(Wanted), Control(Control), Current(NULL), Complete(false) {}
+};
+
+// Collect the names of the members, skipping their data.
+class DebScanFileListStream : public pkgDirStream
+{
+    std::vector<std::string> &FileList;
+
+public:
+    virtual bool DoItem(Item &Itm,int &Fd) { Fd = -1; return true; }
+    virtual bool FinishedFile(Item &Itm,int Fd)
+    {
+        FileList.push_back(Itm.Name);
+        return true;
+    }
+
+    DebScanFileListStream(std::vector<std::string> &FileList) :
+        FileList(FileList) {}
+};
+
+static bool ScanDeb(DebScan const &Scan, DebScanResult &Res)
+{
+    FileFd Fd(Res.Path, FileFd::ReadOnly);
+    if (Fd.IsOpen() == false)
+        return false;
+    ARArchive AR(Fd);
+    if (_error->PendingError() == true)
+        return false;
+
+    std::string Compressor;
+    if (Scan.Control.empty() == false) {
+        const ARArchive::Member *Member = PyDebFile_FindTar(AR, "control.tar",
+                                                            Compressor);
+        if (Member == NULL || Fd.Seek(Member->Start) == false)
+            return false;
+        ExtractTar Tar(Fd, Member->Size, Compressor);
+        DebScanControlStream Stream(Scan.Control, Res.Control);
+        if (Tar.Go(Stream) == false && Stream.Complete == false)
+            return false;
+    }
+
+    if (Scan.FileList) {
+        const ARArchive::Member *Member = PyDebFile_FindTar(AR, "data.tar",
+                                                            Compressor);
+        if (Member == NULL || Fd.Seek(Member->Start) == false)
+            return false;
+        ExtractTar Tar(Fd, Member->Size, Compressor);
+        DebScanFileListStream Stream(Res.FileList);
+        if (Tar.Go(Stream) == false)
+            return false;
+    }
+    return _error->PendingError() == false;
+}
+
+void DebScan::Work()
+{
+    for (;;) {
+        DebScanResult Res;
+        {
+            std::unique_lock<std::mutex> Guard(Lock);
+            Cond.wait(Guard, [this] {
+                return Cancelled || Results.size() < MaxQueued;
+            });
+            if (Cancelled || Next == Paths.size())
+                break;
+            Res.Path = Paths[Next++];
+        }
+
+        bool Scanned;
+        try {
+            Scanned = ScanDeb(*this, Res);
+        } catch (std::exception const &e) {
+            // Such as std::bad_alloc, which must not end the process
+            _error->Error("Could not scan %s: %s", Res.Path.c_str(), e.what());
+            Scanned = false;
+        }
+        if (Scanned == false) {
+            // Format the messages like HandleErrors() does.
+            while (_error->empty() == false) {
+                std::string Msg;
+                bool Type = _error->PopMessage(Msg);
+                if (Res.Error.empty() == false)
+                    Res.Error.append(", ");
+                Res.Error.append(Type == true ? "E:" : "W:");
+                Res.Error.append(Msg);
+            }
+            if (Res.Error.empty())
+                Res.Error = "Internal Error";
+        }
+        _error->Discard();
+
+        std::lock_guard<std::mutex> Guard(Lock);
+        Results.push_back(std::move(Res));
+        Cond.notify_all();
+    }
+
+    std::lock_guard<std::mutex> Guard(Lock);
+    Running--;
+    Cond.notify_all();
+}
+
+// Wait for the next result. Returns false once all packages were scanned.
+bool DebScan::Pop(DebScanResult &Res)
+{
+    std::unique_lock<std::mutex> Guard(Lock);
+    Cond.wait(Guard, [this] { return Results.empty() == false || Running == 0; });
+    if (Results.empty())
+        return false;
+    Res = std::move(Results.front());
+    Results.pop_front();
+    Cond.notify_all();
+    return true;
+}
+
+// Let the workers finish their current package, and wait for them.
+void DebScan::Stop()
+{
+    {
+        std::lock_guard<std::mutex> Guard(Lock);
+        Cancelled = true;
+    }
+    Cond.notify_all();
+    for (auto &Worker : Workers)
+        Worker.join();
+    Workers.clear();
+}
+
+static PyObject *debscan_result(DebScan *scan, DebScanResult &Res)
+{
+    PyObject *result;
+    if (Res.Error.empty() == false) {
+        result = PyObject_CallFunction(PyAptError, "s", Res.Error.c_str());
+    } else {
+        result = PyDict_New();
+        for (auto const &Name : scan->Want) {
+            if (result == NULL)
+                break;
+            PyObject *value;
+            if (Name == "filelist") {
+                value = PyList_New(Res.FileList.size());
+                for (size_t i = 0; value != NULL && i < Res.FileList.size(); i++) {
+                    PyObject *path = CppPyPath(Res.FileList[i]);
+                    if (path == NULL)
+                        Py_CLEAR(value);
+                    else
+                        PyList_SET_ITEM(value, i, path);
+                }
+            } else {
+                auto Member = Res.Control.find(Name);
+                if (Member == Res.Control.end()) {
+                    Py_INCREF(Py_None);
+                    value = Py_None;
+                } else {
+                    value = PyBytes_FromStringAndSize(Member->second.data(),
+                                                      Member->second.size());
+                }
+            }
+            if (value == NULL || PyDict_SetItemString(result, Name.c_str(),
+                                                      value) == -1)
+                Py_CLEAR(result);
+            Py_XDECREF(value);
+        }
+    }
+    if (result == NULL)
+        return NULL;
+    PyObject *path = CppPyPath(Res.Path);
+    if (path == NULL) {
+        Py_DECREF(result);
+        return NULL;
+    }
+    return Py_BuildValue("(NN)", path, result);
+}
+
+static PyObject *debscan_next(PyObject *self)
+{
+    DebScan *scan = GetCpp<DebScan*>(self);
+    DebScanResult Res;
+    bool found;
+    Py_BEGIN_ALLOW_THREADS
+    found = scan->Pop(Res);
+    Py_END_ALLOW_THREADS
+    if (found == false)
+        return NULL;
+    return debscan_result(scan, Res);
+}
+
+static void debscan_dealloc(PyObject *self)
+{
+    Py_BEGIN_ALLOW_THREADS
+    GetCpp<DebScan*>(self)->Stop();
+    Py_END_ALLOW_THREADS
+    CppDeallocPtr<DebScan*>(self);
+}
+
+static const char *debscan_doc =
+    "An iterator over the results of scan_debs().";
+PyTypeObject PyDebScan_Type = {
+    PyVarObject_HEAD_INIT(&PyType_Type, 0)
+    "apt_inst.DebScan",                  // tp_name
+    sizeof(CppPyObject<DebScan*>),       // tp_basicsize
+    0,                                   // tp_itemsize
+    // Methods
+    debscan_dealloc,                     // tp_dealloc
+    0,                                   // tp_print
+    0,                                   // tp_getattr
+    0,                                   // tp_setattr
+    0,                                   // tp_compare
+    0,                                   // tp_repr
+    0,                                   // tp_as_number
+    0,                                   // tp_as_sequence
+    0,                                   // tp_as_mapping
+    0,                                   // tp_hash
+    0,                                   // tp_call
+    0,                                   // tp_str
+    0,                                   // tp_getattro
+    0,                                   // tp_setattro
+    0,                                   // tp_as_buffer
+    Py_TPFLAGS_DEFAULT,                  // tp_flags
+    debscan_doc,                         // tp_doc
+    0,                                   // tp_traverse
+    0,                                   // tp_clear
+    0,                                   // tp_richcompare
+    0,                                   // tp_weaklistoffset
+    PyObject_SelfIter,                   // tp_iter
+    debscan_next,                        // tp_iternext
+};
+
+const char *doc_ScanDebs =
+    "scan_debs(paths: list[, want: tuple, threads: int]) -> iterator\n\n"
+    "Scan the .deb files in 'paths' using 'threads' worker threads, which\n"
+    "do not hold the GIL, and return an iterator yielding a tuple\n"
+    "(path, result) for each package in the order in which they are\n"
+    "finished.\n\n"
+    "The result is a dict with an entry for each name in 'want', which\n"
+    "defaults to ('control', 'filelist', 'md5sums'). The entry 'filelist'\n"
+    "is the list of members of the data archive; any other name is the\n"
+    "content of the member of the control archive with that name, as bytes,\n"
+    "or None if the package has no such member. If a package could not be\n"
+    "read, the result is an apt_pkg.Error instance instead of a dict.\n\n"
+    "The default number of threads is the number of CPUs.";
+PyObject *ScanDebs(PyObject *Self,PyObject *Args,PyObject *kwds)
+{
+    PyObject *paths;
+    PyObject *want = NULL;
+    int threads = 0;
+    static char *kwlist[] = {"paths", "want", "threads", NULL};
+    if (PyArg_ParseTupleAndKeywords(Args, kwds, "O|Oi:scan_debs", kwlist,
+                                    &paths, &want, &threads) == 0)
+        return 0;
+    if (threads < 0) {
+        PyErr_SetString(PyExc_ValueError, "threads must not be negative");
+        return 0;
+    }
+
+    std::unique_ptr<DebScan> scan(new DebScan());
+    PyObject *seq = PySequence_Fast(paths, "paths must be a sequence");
+    if (seq == NULL)
+        return 0;
+    for (Py_ssize_t i = 0; i < PySequence_Fast_GET_SIZE(seq); i++) {
+        PyApt_Filename path;
+        if (!path.init(PySequence_Fast_GET_ITEM(seq, i))) {
+            Py_DECREF(seq);
+            return 0;
+        }
+        scan->Paths.push_back(path.path);
+    }
+    Py_DECREF(seq);
+
+    if (want == NULL) {
+        scan->Want = {"control", "filelist", "md5sums"};
+    } else {
+        seq = PySequence_Fast(want, "want must be a sequence");
+        if (seq == NULL)
+            return 0;
+        for (Py_ssize_t i = 0; i < PySequence_Fast_GET_SIZE(seq); i++) {
+            const char *name = PyObject_AsString(PySequence_Fast_GET_ITEM(seq, i));
+            if (name == NULL) {
+                Py_DECREF(seq);
+                return 0;
+            }
+            scan->Want.push_back(name);
+        }
+        Py_DECREF(seq);
+    }
+    for (auto const &Name : scan->Want) {
+        if (Name == "filelist")
+            scan->FileList = true;
+        else
+            scan->Control.insert(Name);
+    }
+
+    if (threads == 0)
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    threads = std::min<size_t>(threads, scan->Paths.size());
+    scan->MaxQueued = 2 * threads;
+    // Fill the compressor cache before the workers use it.
+    APT::Configuration::getCompressors();
+
+    scan->Running = threads;
+    for (int i = 0; i < threads; i++) {
+        try {
+            scan->Workers.push_back(std::thread(&DebScan::Work, scan.get()));
+        } catch (std::system_error &e) {
+            {
+                std::lock_guard<std::mutex> Guard(scan->Lock);
+                scan->Running -= threads - i;
+            }
+            Py_BEGIN_ALLOW_THREADS
+            scan->Stop();
+            Py_END_ALLOW_THREADS
+            return PyErr_Format(PyExc_OSError, "Could not start thread: %s",
+                                e.what());
+        }
+    }
+
+    CppPyObject<DebScan*> *result =
+        CppPyObject_NEW<DebScan*>(NULL, &PyDebScan_Type, scan.release());
+    return result;
+}
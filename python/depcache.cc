@@ -26,6 +26,7 @@
 #include <Python.h>
 
 #include <iostream>
+#include <vector>
 #include "progress.h"
 
 #ifndef _
@@ -41,6 +42,98 @@
 } while(0)
 
 
+// DepCacheJournal - Track package state changes			/*{{{*/
+// ---------------------------------------------------------------------
+/* The journal keeps a compact copy of the state of every package and
+   stamps each package with the generation in which its state was last
+   seen to differ from that copy. Asking for the changes since a token
+   is then a single native pass over the state table instead of a
+   Python loop calling one marked_*() method per package. */
+struct DepCacheJournal
+{
+   struct Entry
+   {
+      pkgCache::Version *InstallVer;
+      pkgCache::Version *CandidateVer;
+      unsigned short Flags;
+      unsigned short iFlags;
+      unsigned char Mode;
+      unsigned char DepState;
+      bool Garbage;
+
+      bool operator ==(Entry const &o) const {
+	 return InstallVer == o.InstallVer && CandidateVer == o.CandidateVer &&
+	        Flags == o.Flags && iFlags == o.iFlags && Mode == o.Mode &&
+	        DepState == o.DepState && Garbage == o.Garbage;
+      }
+      bool operator !=(Entry const &o) const { return !(*this == o); }
+   };
+
+   std::vector<Entry> Snapshot;
+   std::vector<unsigned long long> Stamp;
+   unsigned long long Generation;
+   // The generation in which the snapshot was last rebuilt; older tokens
+   // can not be answered and need a full resync.
+   unsigned long long ResetGeneration;
+
+   DepCacheJournal() : Generation(0), ResetGeneration(0) {}
+
+   static Entry MakeEntry(pkgDepCache::StateCache const &State)
+   {
+      Entry E;
+      E.InstallVer = State.InstallVer;
+      E.CandidateVer = State.CandidateVer;
+      E.Flags = State.Flags;
+      E.iFlags = State.iFlags;
+      E.Mode = State.Mode;
+      E.DepState = State.DepState;
+      E.Garbage = State.Garbage;
+      return E;
+   }
+
+   // Compare the snapshot with the live state and stamp what changed.
+   void Sync(pkgDepCache &Cache)
+   {
+      unsigned long const Count = Cache.Head().PackageCount;
+      if (Snapshot.size() != Count)
+      {
+	 // The cache was rebuilt, so the changes since older tokens are lost.
+	 if (Snapshot.empty() == false)
+	    ResetGeneration = ++Generation;
+	 Snapshot.resize(Count);
+	 Stamp.assign(Count, Generation);
+	 for (pkgCache::PkgIterator P = Cache.PkgBegin(); P.end() == false; ++P)
+	    Snapshot[P->ID] = MakeEntry(Cache[P]);
+	 return;
+      }
+
+      bool Changed = false;
+      for (pkgCache::PkgIterator P = Cache.PkgBegin(); P.end() == false; ++P)
+      {
+	 Entry const E = MakeEntry(Cache[P]);
+	 if (E == Snapshot[P->ID])
+	    continue;
+	 Snapshot[P->ID] = E;
+	 Stamp[P->ID] = Generation + 1;
+	 Changed = true;
+      }
+      if (Changed == true)
+	 ++Generation;
+   }
+};
+
+struct PyDepCacheObject : public CppPyObject<pkgDepCache*>
+{
+   DepCacheJournal *Journal;
+};
+
+static void PkgDepCacheDealloc(PyObject *Self)
+{
+   delete ((PyDepCacheObject *)Self)->Journal;
+   ((PyDepCacheObject *)Self)->Journal = NULL;
+   CppDeallocPtr<pkgDepCache *>(Self);
+}
+									/*}}}*/
 // DepCache Class								/*{{{*/
 // ---------------------------------------------------------------------
 
@@ -605,6 +698,50 @@ static PyObject *PkgDepCacheMarkedReinstall(PyObject *Self,PyObject *Args)
    return HandleErrors(PyBool_FromLong(res));
 }
 
+static PyObject *PkgDepCacheChangesSince(PyObject *Self,PyObject *Args)
+{
+   pkgDepCache *depcache = GetCpp<pkgDepCache *>(Self);
+   PyDepCacheObject *Obj = (PyDepCacheObject *)Self;
+   PyObject *Owner = GetOwner<pkgDepCache*>(Self);
+
+   unsigned long long Token = 0;
+   if (PyArg_ParseTuple(Args,"|K",&Token) == 0)
+      return 0;
+
+   if (Obj->Journal == NULL)
+      Obj->Journal = new DepCacheJournal();
+   DepCacheJournal &Journal = *Obj->Journal;
+
+   Journal.Sync(*depcache);
+   if (Token > Journal.Generation) {
+      PyErr_SetString(PyExc_ValueError, "Token was not issued by this DepCache");
+      return nullptr;
+   }
+
+   if (Token < Journal.ResetGeneration)
+      return HandleErrors(Py_BuildValue("(KO)", Journal.Generation, Py_None));
+
+   PyObject *List = PyList_New(0);
+   if (List == nullptr)
+      return nullptr;
+   if (Token < Journal.Generation) {
+      for (pkgCache::PkgIterator P = depcache->PkgBegin(); P.end() == false; ++P)
+      {
+	 if (Journal.Stamp[P->ID] <= Token)
+	    continue;
+	 PyObject *Pkg = CppPyObject_NEW<pkgCache::PkgIterator>(Owner,&PyPackage_Type,P);
+	 int Res = Pkg != nullptr ? PyList_Append(List, Pkg) : -1;
+	 Py_XDECREF(Pkg);
+	 if (Res == -1) {
+	    Py_DECREF(List);
+	    return nullptr;
+	 }
+      }
+   }
+
+   PyObject *Result = Py_BuildValue("(KN)", Journal.Generation, List);
+   return HandleErrors(Result);
+}
 
 static PyMethodDef PkgDepCacheMethods[] =
 {
@@ -699,6 +836,14 @@ static PyMethodDef PkgDepCacheMethods[] =
    {"marked_downgrade",PkgDepCacheMarkedDowngrade,METH_VARARGS,
     "marked_downgrade(pkg: apt_pkg.Package) -> bool\n\n"
     "Check whether the package is marked for downgrade."},
+   {"changes_since",PkgDepCacheChangesSince,METH_VARARGS,
+    "changes_since([token: int = 0]) -> (int, list)\n\n"
+    "Return a new token and a list of apt_pkg.Package objects whose state\n"
+    "(marking, candidate, auto flag, breakage) changed after 'token' was\n"
+    "returned by an earlier call. The first call starts the journal and\n"
+    "returns an empty list; pass the returned token to the next call.\n"
+    "If the changes since 'token' were lost because the package count\n"
+    "changed, the list is None and all packages must be rechecked."},
    // Action
    {"commit", PkgDepCacheCommit, METH_VARARGS,
     "commit(acquire_progress, install_progress)\n\n"
@@ -795,10 +940,10 @@ PyTypeObject PyDepCache_Type =
 {
    PyVarObject_HEAD_INIT(&PyType_Type, 0)
    "apt_pkg.DepCache",                  // tp_name
-   sizeof(CppPyObject<pkgDepCache *>),   // tp_basicsize
+   sizeof(PyDepCacheObject),            // tp_basicsize
    0,                                   // tp_itemsize
    // Methods
-   CppDeallocPtr<pkgDepCache *>,   // tp_dealloc
+   PkgDepCacheDealloc,                  // tp_dealloc
    0,                                   // tp_print
    0,                                   // tp_getattr
    0,                                   // tp_setattr
@@ -13,6 +13,9 @@ using namespace std;
 
 
 #include <apt-pkg/error.h>
+#include <apt-pkg/hashes.h>
+
+#include <strings.h>
 									/*}}}*/
 
 // HandleErrors - This moves errors from _error to Python Exceptions	/*{{{*/
@@ -91,6 +94,59 @@ PyObject *CharCharToList(const char **List,unsigned long Size)
    return PList;
 }
 									/*}}}*/
+// IntVectorToArray - Convert ints to an array.array of C ints		/*{{{*/
+// ---------------------------------------------------------------------
+/* The values are copied in one go, without creating int objects. */
+PyObject *IntVectorToArray(std::vector<int> const &Values)
+{
+   PyObject *Module = PyImport_ImportModule("array");
+   if (Module == 0)
+      return 0;
+   PyObject *Bytes = PyBytes_FromStringAndSize((const char *)Values.data(),
+					       Values.size() * sizeof(int));
+   PyObject *Res = 0;
+   if (Bytes != 0)
+      Res = PyObject_CallMethod(Module,"array","sO","i",Bytes);
+   Py_XDECREF(Bytes);
+   Py_DECREF(Module);
+   return Res;
+}
+									/*}}}*/
+
+// HashTypesToMask - Convert hash names to Hashes::SupportedHashes	/*{{{*/
+// ---------------------------------------------------------------------
+/* The names are matched ignoring case, and "md5sum" is accepted for "md5"
+   as well. Unknown names raise ValueError. */
+bool HashTypesToMask(PyObject *Types,unsigned int &Mask)
+{
+   PyObject *Seq = PySequence_Fast(Types,"types must be a sequence");
+   if (Seq == 0)
+      return false;
+   Mask = 0;
+   Py_ssize_t Len = PySequence_Fast_GET_SIZE(Seq);
+   for (Py_ssize_t I = 0; I < Len; I++)
+   {
+      const char *Type = PyObject_AsString(PySequence_Fast_GET_ITEM(Seq,I));
+      if (Type == 0)
+	 break;
+      if (strcasecmp(Type,"md5") == 0 || strcasecmp(Type,"md5sum") == 0)
+	 Mask |= Hashes::MD5SUM;
+      else if (strcasecmp(Type,"sha1") == 0)
+	 Mask |= Hashes::SHA1SUM;
+      else if (strcasecmp(Type,"sha256") == 0)
+	 Mask |= Hashes::SHA256SUM;
+      else if (strcasecmp(Type,"sha512") == 0)
+	 Mask |= Hashes::SHA512SUM;
+      else
+      {
+	 PyErr_Format(PyExc_ValueError,"Unknown hash type: %s",Type);
+	 break;
+      }
+   }
+   Py_DECREF(Seq);
+   return PyErr_Occurred() == 0;
+}
+									/*}}}*/
 
 int PyApt_Filename::init(PyObject *object)
 {
@@ -29,6 +29,7 @@
 
 #include <Python.h>
 #include <string>
+#include <vector>
 #include <iostream>
 #include <new>
 #include <langinfo.h>
@@ -252,6 +253,12 @@ PyObject *HandleErrors(PyObject *Res = 0);
 const char **ListToCharChar(PyObject *List,bool NullTerm = false);
 PyObject *CharCharToList(const char **List,unsigned long Size = 0);
 
+// Convert a vector of ints to an array.array('i')
+PyObject *IntVectorToArray(std::vector<int> const &Values);
+
+// Convert a sequence of hash names to a mask of Hashes::SupportedHashes
+bool HashTypesToMask(PyObject *Types,unsigned int &Mask);
+
 /* Happy number conversion, thanks to overloading */
 inline PyObject *MkPyNumber(unsigned long long o) { return PyLong_FromUnsignedLongLong(o); }
 inline PyObject *MkPyNumber(unsigned long o) { return PyLong_FromUnsignedLong(o); }
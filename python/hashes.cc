@@ -22,34 +22,259 @@
 #include "apt_pkgmodule.h"
 #include <apt-pkg/hashes.h>
 
+#include <errno.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <condition_variable>
+#include <mutex>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+/**
+ * A Hashes object which may calculate its digests in parallel.
+ *
+ * With parallel=True, Object only calculates the first selected digest,
+ * and Parts holds one more Hashes object for each other digest, so that
+ * each of them can be fed from its own thread.
+ */
+struct PyHashesObject : public CppPyObject<Hashes> {
+    std::vector<Hashes*> *Parts;
+    // Serializes update() calls running without the GIL; created by the
+    // first of them.
+    PyThread_type_lock Lock;
+    // Set once the hashes were read, which finalizes them.
+    bool Finished;
+};
+
+// update() releases the GIL for chunks of this size, and hashes them on
+// several threads with parallel=True from ParallelMinSize on.
+static const size_t HashesNoGILMinSize = 64 * 1024;
+static const size_t HashesParallelMinSize = 1024 * 1024;
+
 static PyObject *hashes_new(PyTypeObject *type,PyObject *args,
                             PyObject *kwds)
 {
     return CppPyObject_NEW<Hashes>(NULL, type);
 }
 
+static void hashes_dealloc(PyObject *self)
+{
+    std::vector<Hashes*> *parts = ((PyHashesObject *)self)->Parts;
+    if (parts != NULL) {
+        for (Hashes *part : *parts)
+            delete part;
+        delete parts;
+    }
+    if (((PyHashesObject *)self)->Lock != NULL)
+        PyThread_free_lock(((PyHashesObject *)self)->Lock);
+    CppDealloc<Hashes>(self);
+}
+
+/**
+ * The buffers shared by the threads of hashes_add_fd_parallel().
+ *
+ * The reader fills the slots in turn, and each slot is reused once all
+ * hashing threads are done with it, so reading the next chunks overlaps
+ * with hashing the previous ones.
+ */
+struct ParallelHashBuffers {
+    static const int Slots = 4;
+    static const size_t SlotSize = 1 << 20;
+
+    std::mutex Lock;
+    std::condition_variable Cond;
+    std::vector<unsigned char> Data[Slots];
+    size_t Size[Slots];
+    // The number of threads which still need to hash each slot.
+    size_t Pending[Slots];
+    // The number of chunks read so far, and whether reading stopped.
+    unsigned long long Posted;
+    bool Eof;
+
+    ParallelHashBuffers() : Posted(0), Eof(false) {
+        for (int I = 0; I < Slots; I++) {
+            Size[I] = 0;
+            Pending[I] = 0;
+        }
+    }
+
+    void Hash(Hashes *Part) {
+        for (unsigned long long Chunk = 0;; Chunk++) {
+            int Slot = Chunk % Slots;
+            {
+                std::unique_lock<std::mutex> Guard(Lock);
+                Cond.wait(Guard, [&] { return Posted > Chunk || Eof; });
+                if (Posted <= Chunk)
+                    return;
+            }
+            Part->Add(Data[Slot].data(), Size[Slot]);
+            std::lock_guard<std::mutex> Guard(Lock);
+            if (--Pending[Slot] == 0)
+                Cond.notify_all();
+        }
+    }
+};
+
+// Run Func(Part) for each of the Parts on a thread of its own.
+template<typename F>
+static bool hashes_run_parallel(std::vector<Hashes*> const &Parts, F Func)
+{
+    std::vector<std::thread> Threads;
+    bool Res = true;
+    try {
+        for (Hashes *Part : Parts)
+            Threads.emplace_back(Func, Part);
+    } catch (std::system_error &e) {
+        errno = e.code().value();
+        Res = false;
+    }
+    for (auto &Thread : Threads)
+        Thread.join();
+    return Res;
+}
+
+// Read Size bytes of Fd, or up to the end if Size is 0, once, and feed
+// them to each of the Parts on its own thread.
+static bool hashes_add_fd_parallel(std::vector<Hashes*> const &Parts, int Fd,
+                                   unsigned long long Size)
+{
+    ParallelHashBuffers Buffers;
+    std::vector<std::thread> Threads;
+    try {
+        for (Hashes *Part : Parts)
+            Threads.emplace_back(&ParallelHashBuffers::Hash, &Buffers, Part);
+    } catch (std::system_error &e) {
+        Buffers.Eof = true;
+        Buffers.Cond.notify_all();
+        for (auto &Thread : Threads)
+            Thread.join();
+        errno = e.code().value();
+        return false;
+    }
+
+    int Error = 0;
+    unsigned long long Done = 0;
+    for (unsigned long long Chunk = 0;; Chunk++) {
+        int Slot = Chunk % Buffers.Slots;
+        {
+            std::unique_lock<std::mutex> Guard(Buffers.Lock);
+            Buffers.Cond.wait(Guard, [&] { return Buffers.Pending[Slot] == 0; });
+        }
+        std::vector<unsigned char> &Data = Buffers.Data[Slot];
+        Data.resize(Buffers.SlotSize);
+        size_t Want = Data.size();
+        if (Size != 0 && Size - Done < Want)
+            Want = Size - Done;
+        ssize_t Res = 0;
+        while (Want != 0 && (Res = read(Fd, Data.data(), Want)) < 0 &&
+               errno == EINTR)
+            ;
+        if (Res < 0)
+            Error = errno;
+
+        std::lock_guard<std::mutex> Guard(Buffers.Lock);
+        if (Res <= 0) {
+            Buffers.Eof = true;
+            Buffers.Cond.notify_all();
+            break;
+        }
+        Done += Res;
+        Buffers.Size[Slot] = Res;
+        Buffers.Pending[Slot] = Parts.size();
+        Buffers.Posted++;
+        Buffers.Cond.notify_all();
+    }
+
+    for (auto &Thread : Threads)
+        Thread.join();
+    errno = Error;
+    if (Error == 0 && Size != 0 && Done != Size)
+        errno = EIO;
+    return errno == 0;
+}
+
 static int hashes_init(PyObject *self, PyObject *args, PyObject *kwds)
 {
     PyObject *object = 0;
+    PyObject *types = 0;
+    char parallel = 0;
     int Fd;
-    char *kwlist[] = {"object",  NULL};
+    char *kwlist[] = {"object", "types", "parallel", NULL};
 
-    if (PyArg_ParseTupleAndKeywords(args, kwds, "|O:__init__", kwlist,
-                                    &object) == 0)
+    if (PyArg_ParseTupleAndKeywords(args, kwds, "|OOb:__init__", kwlist,
+                                    &object, &types, &parallel) == 0)
         return -1;
+    Hashes &hashes = GetCpp<Hashes>(self);
+    PyHashesObject *pyhashes = (PyHashesObject *)self;
+
+    unsigned int mask = Hashes::MD5SUM | Hashes::SHA1SUM |
+                        Hashes::SHA256SUM | Hashes::SHA512SUM;
+    if (types != 0 && types != Py_None) {
+        if (HashTypesToMask(types, mask) == false)
+            return -1;
+        if (mask == 0) {
+            PyErr_SetString(PyExc_ValueError, "types must not be empty");
+            return -1;
+        }
+    }
+
+    // Split the selected digests into one Hashes object each.
+    std::vector<Hashes*> parts;
+    unsigned int first = mask;
+    if (parallel) {
+        for (unsigned int bit = 1; bit <= Hashes::SHA512SUM; bit <<= 1) {
+            if ((mask & bit) == 0)
+                continue;
+            if (first == mask)
+                first = bit;
+            else
+                parts.push_back(new Hashes(bit));
+        }
+    }
+    if ((types != 0 && types != Py_None) || parts.empty() == false) {
+        hashes.~Hashes();
+        new (&hashes) Hashes(first);
+    }
+    if (parts.empty() == false)
+        pyhashes->Parts = new std::vector<Hashes*>(parts);
+    // Hash everything with the GIL released, on all parts.
+    parts.insert(parts.begin(), &hashes);
+
     if (object == 0)
         return 0;
-    Hashes &hashes = GetCpp<Hashes>(self);
 
     if (PyBytes_Check(object) != 0) {
         char *s;
         Py_ssize_t len;
         PyBytes_AsStringAndSize(object, &s, &len);
-        hashes.Add((const unsigned char*)s, len);
+        bool res = true;
+        Py_BEGIN_ALLOW_THREADS
+        if (parts.size() == 1)
+            hashes.Add((const unsigned char*)s, len);
+        else
+            res = hashes_run_parallel(parts, [=](Hashes *part) {
+                part->Add((const unsigned char*)s, len);
+            });
+        Py_END_ALLOW_THREADS
+        if (res == false) {
+            PyErr_SetFromErrno(PyAptError);
+            return -1;
+        }
     }
     else if ((Fd = PyObject_AsFileDescriptor(object)) != -1) {
         struct stat St;
-        if (fstat(Fd, &St) != 0 || hashes.AddFD(Fd, St.st_size) == false) {
+        bool res = false;
+        Py_BEGIN_ALLOW_THREADS
+        if (fstat(Fd, &St) != 0)
+            res = false;
+        else if (parts.size() == 1)
+            res = hashes.AddFD(Fd, St.st_size);
+        else
+            res = hashes_add_fd_parallel(parts, Fd, St.st_size);
+        Py_END_ALLOW_THREADS
+        if (res == false) {
             PyErr_SetFromErrno(PyAptError);
             return -1;
         }
@@ -62,14 +287,104 @@ static int hashes_init(PyObject *self, PyObject *args, PyObject *kwds)
     return 0;
 }
 
+// Take the lock of an object which update() used without the GIL.
+static void hashes_lock(PyHashesObject *self)
+{
+    if (self->Lock == NULL || PyThread_acquire_lock(self->Lock, 0) != 0)
+        return;
+    Py_BEGIN_ALLOW_THREADS
+    PyThread_acquire_lock(self->Lock, 1);
+    Py_END_ALLOW_THREADS
+}
+
+static void hashes_unlock(PyHashesObject *self)
+{
+    if (self->Lock != NULL)
+        PyThread_release_lock(self->Lock);
+}
+
 static PyObject *hashes_get_hashes(PyObject *self, void*)
 {
+    PyHashesObject *pyhashes = (PyHashesObject *)self;
     auto py = CppPyObject_NEW<HashStringList>(nullptr, &PyHashStringList_Type);
 
+    hashes_lock(pyhashes);
     py->Object = GetCpp<Hashes>(self).GetHashStringList();
+    if (pyhashes->Parts != NULL) {
+        for (Hashes *part : *pyhashes->Parts)
+            for (auto const &hash : part->GetHashStringList())
+                py->Object.push_back(hash);
+    }
+    pyhashes->Finished = true;
+    hashes_unlock(pyhashes);
     return py;
 }
 
+static const char hashes_update_doc[] =
+    "update(data: bytes-like)\n\n"
+    "Add the data to the hashes. The parameter *data* may be any object\n"
+    "supporting the buffer protocol, such as bytes, bytearray, memoryview\n"
+    "or mmap objects; it is hashed in place, without being copied. The GIL\n"
+    "is released for chunks of 64 KiB or more.\n\n"
+    "Reading :attr:`hashes` finalizes the hashes, so this raises\n"
+    "ValueError afterwards.\n\n"
+    ".. versionadded:: 2.1";
+static PyObject *hashes_update(PyObject *self, PyObject *arg)
+{
+    PyHashesObject *pyhashes = (PyHashesObject *)self;
+    Py_buffer view;
+    if (PyObject_GetBuffer(arg, &view, PyBUF_SIMPLE) == -1)
+        return 0;
+
+    std::vector<Hashes*> parts(1, &GetCpp<Hashes>(self));
+    if (pyhashes->Parts != NULL)
+        parts.insert(parts.end(), pyhashes->Parts->begin(),
+                     pyhashes->Parts->end());
+    const unsigned char *data = (const unsigned char *)view.buf;
+    size_t len = view.len;
+
+    if (len >= HashesNoGILMinSize && pyhashes->Lock == NULL &&
+        (pyhashes->Lock = PyThread_allocate_lock()) == NULL) {
+        PyBuffer_Release(&view);
+        return PyErr_NoMemory();
+    }
+
+    bool res = true;
+    hashes_lock(pyhashes);
+    if (pyhashes->Finished) {
+        hashes_unlock(pyhashes);
+        PyBuffer_Release(&view);
+        PyErr_SetString(PyExc_ValueError, "The hashes were already read");
+        return 0;
+    }
+    if (len < HashesNoGILMinSize) {
+        for (Hashes *part : parts)
+            res &= part->Add(data, len);
+    } else {
+        Py_BEGIN_ALLOW_THREADS
+        if (parts.size() > 1 && len >= HashesParallelMinSize) {
+            res = hashes_run_parallel(parts, [=](Hashes *part) {
+                part->Add(data, len);
+            });
+        } else {
+            for (Hashes *part : parts)
+                res &= part->Add(data, len);
+        }
+        Py_END_ALLOW_THREADS
+    }
+    hashes_unlock(pyhashes);
+    PyBuffer_Release(&view);
+
+    if (res == false)
+        return PyErr_SetFromErrno(PyAptError);
+    Py_RETURN_NONE;
+}
+
+static PyMethodDef hashes_methods[] = {
+    {"update",hashes_update,METH_O,hashes_update_doc},
+    {}
+};
+
 
 static PyGetSetDef hashes_getset[] = {
     {"hashes",hashes_get_hashes,0,
@@ -79,19 +394,26 @@ static PyGetSetDef hashes_getset[] = {
 };
 
 static char *hashes_doc =
-    "Hashes([object: (bytes, file)])\n\n"
+    "Hashes([object: (bytes, file), types: list, parallel: bool = False])\n\n"
     "Calculate hashes for the given object. It can be used to create all\n"
     "supported hashes for a file.\n\n"
     "The parameter *object* can be a bytestring, an object providing the\n"
-    "fileno() method, or an integer describing a file descriptor.";
+    "fileno() method, or an integer describing a file descriptor. The GIL\n"
+    "is released while it is hashed.\n\n"
+    "The parameter *types* is a sequence of the hashes to calculate, out\n"
+    "of 'md5', 'sha1', 'sha256' and 'sha512'. By default, all of them are\n"
+    "calculated. If *parallel* is True, each hash is calculated on a thread\n"
+    "of its own; files are still read only once.\n\n"
+    ".. versionchanged:: 2.1\n"
+    "    The *types* and *parallel* parameters.";
 
 PyTypeObject PyHashes_Type = {
     PyVarObject_HEAD_INIT(&PyType_Type, 0)
     "apt_pkg.Hashes",                  // tp_name
-    sizeof(CppPyObject<Hashes>),       // tp_basicsize
+    sizeof(PyHashesObject),            // tp_basicsize
     0,                                 // tp_itemsize
     // Methods
-    CppDealloc<Hashes>,                // tp_dealloc
+    hashes_dealloc,                    // tp_dealloc
     0,                                 // tp_print
     0,                                 // tp_getattr
     0,                                 // tp_setattr
@@ -115,7 +437,7 @@ PyTypeObject PyHashes_Type = {
     0,                                 // tp_weaklistoffset
     0,                                 // tp_iter
     0,                                 // tp_iternext
-    0,                                 // tp_methods
+    hashes_methods,                    // tp_methods
     0,                                 // tp_members
     hashes_getset,                     // tp_getset
     0,                                 // tp_base
@@ -19,9 +19,16 @@
 #include <apt-pkg/install-progress.h>
 #include <apt-pkg/configuration.h>
 #include <apt-pkg/dpkgpm.h>
+#include <apt-pkg/fileutl.h>
+#include <apt-pkg/strutl.h>
 
 #include <iostream>
 
+#include <sys/stat.h>
+
+static void PkgManagerLinkArchives(PyObject *Self, PyObject *Fetcher,
+                                   pkgRecords &Recs);
+
 static PyObject *PkgManagerGetArchives(PyObject *Self,PyObject *Args)
 {
    pkgPackageManager *pm = GetCpp<pkgPackageManager*>(Self);
@@ -32,11 +39,17 @@ static PyObject *PkgManagerGetArchives(PyObject *Self,PyObject *Args)
 			&PySourceList_Type, &list,
 			&PyPackageRecords_Type, &recs) == 0)
       return 0;
+   if (PyAcquire_CheckIdle(fetcher) == false)
+      return 0;
 
    pkgAcquire *s_fetcher = GetCpp<pkgAcquire*>(fetcher);
    pkgSourceList *s_list = GetCpp<pkgSourceList*>(list);
    PkgRecordsStruct &s_records = GetCpp<PkgRecordsStruct>(recs);
 
+   PyAcquireConfigScope scope(fetcher);
+   if (scope.Failed())
+      return 0;
+   PkgManagerLinkArchives(Self, fetcher, s_records.Records);
    bool res = pm->GetArchives(s_fetcher, s_list,
 			      &s_records.Records);
 
@@ -213,11 +226,55 @@ public:
 	void callReset() { return pkgDPkgPM::Reset(); }
 	bool callConfigure(PkgIterator Pkg) { return pkgDPkgPM::Configure(Pkg); }
 	pkgOrderList *getOrderList() { return pkgPackageManager::List; }
+	pkgDepCache &getDepCache() { return pkgPackageManager::Cache; }
 
         PyPkgManager(pkgDepCache *Cache) : pkgDPkgPM(Cache),pyinst(NULL) {};
 	PyObject *pyinst;
 };
 
+/* Link the archives to be fetched from the content cache into the
+ * archives directory, where pkgAcqArchive finds them. The file names
+ * match the ones pkgAcqArchive uses. */
+static void PkgManagerLinkArchives(PyObject *Self, PyObject *Fetcher,
+                                   pkgRecords &Recs)
+{
+   if (_config->Find("Acquire::Content-Cache").empty() ||
+       !PyObject_TypeCheck(Self, &PyPackageManager2_Type))
+      return;
+
+   pkgDepCache &Cache = GetCpp<PyPkgManager*>(Self)->getDepCache();
+   std::string const Archives = _config->FindDir("Dir::Cache::Archives");
+   for (pkgCache::PkgIterator Pkg = Cache.PkgBegin(); !Pkg.end(); ++Pkg)
+   {
+      pkgDepCache::StateCache &State = Cache[Pkg];
+      if (State.Delete() ||
+          (State.Keep() && (State.iFlags & pkgDepCache::ReInstall) == 0))
+         continue;
+      pkgCache::VerIterator Ver = State.InstVerIter(Cache);
+      if (Ver.end())
+         continue;
+
+      for (pkgCache::VerFileIterator Vf = Ver.FileList(); !Vf.end(); ++Vf)
+      {
+         pkgRecords::Parser &Parse = Recs.Lookup(Vf);
+         HashStringList const Hashes = Parse.Hashes();
+         std::string const FileName = Parse.FileName();
+         if (FileName.empty() || Hashes.find("SHA256") == 0)
+            continue;
+
+         std::string const Final = Archives + flNotDir(
+            QuoteString(Pkg.Name(), "_:") + '_' +
+            QuoteString(Ver.VerStr(), "_:") + '_' +
+            QuoteString(Ver.Arch(), "_:.") + "." + flExtension(FileName));
+         struct stat Buf;
+         if (stat(Final.c_str(), &Buf) != 0 ||
+             (unsigned long long)Buf.st_size != Ver->Size)
+            PyAcquire_ContentCacheLink(Fetcher, Hashes, Final);
+         break;
+      }
+   }
+}
+
 static PyObject *PkgManagerNew(PyTypeObject *type,PyObject *Args,PyObject *kwds)
 {
    PyObject *Owner;
@@ -14,6 +14,9 @@
 
 
 #include <Python.h>
+
+#include <algorithm>
+#include <vector>
 									/*}}}*/
 
 
@@ -21,6 +24,22 @@
 // ---------------------------------------------------------------------
 
 
+// Convert a (PackageFile, index) pair to a VerFileIterator, checking the index
+static bool PkgRecordsVerFile(PyObject *PkgFObj,long int Index,
+			      pkgCache::VerFileIterator &VerFile)
+{
+   pkgCache::PkgFileIterator &PkgF = GetCpp<pkgCache::PkgFileIterator>(PkgFObj);
+   pkgCache *Cache = PkgF.Cache();
+   if (Index < 0 || Cache->DataEnd() <= Cache->VerFileP + Index + 1 ||
+       Cache->VerFileP[Index].File != PkgF.MapPointer())
+   {
+      PyErr_SetNone(PyExc_IndexError);
+      return false;
+   }
+   VerFile = pkgCache::VerFileIterator(*Cache,Cache->VerFileP+Index);
+   return true;
+}
+
 static PyObject *PkgRecordsLookup(PyObject *Self,PyObject *Args)
 {
    PkgRecordsStruct &Struct = GetCpp<PkgRecordsStruct>(Self);
@@ -31,27 +50,127 @@ static PyObject *PkgRecordsLookup(PyObject *Self,PyObject *Args)
       return 0;
 
    // Get the index and check to make sure it is reasonable
-   pkgCache::PkgFileIterator &PkgF = GetCpp<pkgCache::PkgFileIterator>(PkgFObj);
-   pkgCache *Cache = PkgF.Cache();
-   if (Cache->DataEnd() <= Cache->VerFileP + Index + 1 ||
-       Cache->VerFileP[Index].File != PkgF.MapPointer())
-   {
-      PyErr_SetNone(PyExc_IndexError);
+   pkgCache::VerFileIterator VerFile;
+   if (PkgRecordsVerFile(PkgFObj,Index,VerFile) == false)
       return 0;
-   }
 
-   // Do the lookup
-   Struct.Last = &Struct.Records.Lookup(pkgCache::VerFileIterator(*Cache,Cache->VerFileP+Index));
+   /* Do the lookup. The parser may have been moved by someone else
+      sharing our pkgRecords (e.g. PackageManager.get_archives), so always
+      jump, but keep the field values if the record did not change. */
+   if (Struct.LastFile != (pkgCache::VerFile *)VerFile)
+      Struct.ClearFields();
+   Struct.Last = &Struct.Records.Lookup(VerFile);
+   Struct.LastFile = VerFile;
 
    // always return true (to make it consistent with the pkgsrcrecords object
    return PyBool_FromLong(1);
 }
 
+static PyObject *PkgRecordsLookupMany(PyObject *Self,PyObject *Args)
+{
+   PkgRecordsStruct &Struct = GetCpp<PkgRecordsStruct>(Self);
+
+   PyObject *PairsObj;
+   PyObject *FieldsObj;
+   if (PyArg_ParseTuple(Args,"OO",&PairsObj,&FieldsObj) == 0)
+      return 0;
+
+   PyObject *Pairs = PySequence_Fast(PairsObj,"pairs must be a sequence");
+   if (Pairs == 0)
+      return 0;
+   PyObject *Fields = PySequence_Fast(FieldsObj,"fields must be a sequence");
+   if (Fields == 0) {
+      Py_DECREF(Pairs);
+      return 0;
+   }
+
+   std::vector<std::string> Names;
+   for (Py_ssize_t I = 0; I < PySequence_Fast_GET_SIZE(Fields); I++) {
+      const char *Name = PyObject_AsString(PySequence_Fast_GET_ITEM(Fields,I));
+      if (Name == 0) {
+	 Py_DECREF(Pairs);
+	 Py_DECREF(Fields);
+	 return 0;
+      }
+      Names.push_back(Name);
+   }
+   Py_DECREF(Fields);
+
+   // Collect the requests with their position in the result
+   Py_ssize_t const Count = PySequence_Fast_GET_SIZE(Pairs);
+   std::vector<std::pair<pkgCache::VerFileIterator,Py_ssize_t> > Requests;
+   Requests.reserve(Count);
+   for (Py_ssize_t I = 0; I < Count; I++) {
+      PyObject *PkgFObj;
+      long int Index;
+      pkgCache::VerFileIterator VerFile;
+      if (PyArg_ParseTuple(PySequence_Fast_GET_ITEM(Pairs,I),"O!l",
+			   &PyPackageFile_Type,&PkgFObj,&Index) == 0 ||
+	  PkgRecordsVerFile(PkgFObj,Index,VerFile) == false) {
+	 Py_DECREF(Pairs);
+	 return 0;
+      }
+      Requests.push_back(std::make_pair(VerFile,I));
+   }
+   Py_DECREF(Pairs);
+
+   /* Visit the records ordered by file and offset, so each index file is
+      read in one forward pass instead of seeking back and forth, which is
+      expensive for compressed files. */
+   std::stable_sort(Requests.begin(),Requests.end(),
+		    [](std::pair<pkgCache::VerFileIterator,Py_ssize_t> const &A,
+		       std::pair<pkgCache::VerFileIterator,Py_ssize_t> const &B) {
+      if (A.first->File != B.first->File)
+	 return A.first->File < B.first->File;
+      return A.first->Offset < B.first->Offset;
+   });
+
+   PyObject *List = PyList_New(Count);
+   if (List == 0)
+      return 0;
+   for (auto const &Request : Requests) {
+      pkgRecords::Parser &Parser = Struct.Records.Lookup(Request.first);
+      PyObject *Values = PyTuple_New(Names.size());
+      if (Values == 0) {
+	 Py_CLEAR(List);
+	 break;
+      }
+      // The list owns the tuple from here on, even if it is incomplete.
+      PyList_SET_ITEM(List,Request.second,Values);
+      for (size_t J = 0; J < Names.size(); J++) {
+	 PyObject *Value = CppPyString(Parser.RecordField(Names[J].c_str()));
+	 if (Value == 0) {
+	    Py_CLEAR(List);
+	    break;
+	 }
+	 PyTuple_SET_ITEM(Values,J,Value);
+      }
+      if (List == 0)
+	 break;
+   }
+
+   // The parsers have moved on, so there is no current record anymore.
+   Struct.Last = 0;
+   Struct.LastFile = 0;
+   Struct.ClearFields();
+
+   if (List == 0)
+      return 0;
+   return HandleErrors(List);
+}
+
 static PyMethodDef PkgRecordsMethods[] =
 {
    {"lookup",PkgRecordsLookup,METH_VARARGS,
     "lookup((packagefile: apt_pkg.PackageFile, index: int)) -> bool\n\n"
     "Changes to a new package"},
+   {"lookup_many",PkgRecordsLookupMany,METH_VARARGS,
+    "lookup_many(pairs: list, fields: list) -> list\n\n"
+    "Look up the (packagefile, index) tuples in 'pairs' and return a list\n"
+    "with one tuple per pair, in the same order, holding the values of the\n"
+    "record fields named in 'fields' ('' for missing fields). The records\n"
+    "are read ordered by file and offset. Afterwards, lookup() has to be\n"
+    "called again before accessing the attributes of this object."},
    {}
 };
 
@@ -68,7 +187,9 @@ static inline PkgRecordsStruct &GetStruct(PyObject *Self,char *name) {
 
 static PyObject *PkgRecordsGetFileName(PyObject *Self,void*) {
    PkgRecordsStruct &Struct = GetStruct(Self,"FileName");
-   return (Struct.Last != 0) ? CppPyPath(Struct.Last->FileName()) : 0;
+   if (Struct.Last == 0)
+      return 0;
+   return Struct.Field(":FileName", [&] { return CppPyPath(Struct.Last->FileName()); });
 }
 static PyObject *PkgRecordsGetHashes(PyObject *Self,void*) {
    PkgRecordsStruct &Struct = GetStruct(Self,"Hashes");
@@ -83,67 +204,89 @@ static PyObject *PkgRecordsGetMD5Hash(PyObject *Self,void*) {
    PkgRecordsStruct &Struct = GetStruct(Self,"MD5Hash");
    if (Struct.Last == NULL)
       return 0;
-   auto hashes = Struct.Last->Hashes();
-   auto hash = hashes.find("md5sum");
-   if (hash == NULL)
-      return 0;
-   return CppPyString(hash->HashValue());
+   return Struct.Field(":MD5Hash", [&]() -> PyObject * {
+      auto hashes = Struct.Last->Hashes();
+      auto hash = hashes.find("md5sum");
+      if (hash == NULL)
+         return 0;
+      return CppPyString(hash->HashValue());
+   });
 }
 static PyObject *PkgRecordsGetSHA1Hash(PyObject *Self,void*) {
    PkgRecordsStruct &Struct = GetStruct(Self,"SHA1Hash");
    if (Struct.Last == NULL)
       return 0;
-   auto hashes = Struct.Last->Hashes();
-   auto hash = hashes.find("sha1");
-   if (hash == NULL)
-      return 0;
-   return CppPyString(hash->HashValue());
+   return Struct.Field(":SHA1Hash", [&]() -> PyObject * {
+      auto hashes = Struct.Last->Hashes();
+      auto hash = hashes.find("sha1");
+      if (hash == NULL)
+         return 0;
+      return CppPyString(hash->HashValue());
+   });
 }
 static PyObject *PkgRecordsGetSHA256Hash(PyObject *Self,void*) {
    PkgRecordsStruct &Struct = GetStruct(Self,"SHA256Hash");
    if (Struct.Last == NULL)
       return 0;
-   auto hashes = Struct.Last->Hashes();
-   auto hash = hashes.find("sha256");
-   if (hash == NULL)
-      return 0;
-   return CppPyString(hash->HashValue());
+   return Struct.Field(":SHA256Hash", [&]() -> PyObject * {
+      auto hashes = Struct.Last->Hashes();
+      auto hash = hashes.find("sha256");
+      if (hash == NULL)
+         return 0;
+      return CppPyString(hash->HashValue());
+   });
 }
 static PyObject *PkgRecordsGetSourcePkg(PyObject *Self,void*) {
    PkgRecordsStruct &Struct = GetStruct(Self,"SourcePkg");
-   return (Struct.Last != 0) ? CppPyString(Struct.Last->SourcePkg()) : 0;
+   if (Struct.Last == 0)
+      return 0;
+   return Struct.Field(":SourcePkg", [&] { return CppPyString(Struct.Last->SourcePkg()); });
 }
 static PyObject *PkgRecordsGetSourceVer(PyObject *Self,void*) {
    PkgRecordsStruct &Struct = GetStruct(Self,"SourceVer");
-   return (Struct.Last != 0) ? CppPyString(Struct.Last->SourceVer()) : 0;
+   if (Struct.Last == 0)
+      return 0;
+   return Struct.Field(":SourceVer", [&] { return CppPyString(Struct.Last->SourceVer()); });
 }
 static PyObject *PkgRecordsGetMaintainer(PyObject *Self,void*) {
    PkgRecordsStruct &Struct = GetStruct(Self,"Maintainer");
-   return (Struct.Last != 0) ? CppPyString(Struct.Last->Maintainer()) : 0;
+   if (Struct.Last == 0)
+      return 0;
+   return Struct.Field(":Maintainer", [&] { return CppPyString(Struct.Last->Maintainer()); });
 }
 static PyObject *PkgRecordsGetShortDesc(PyObject *Self,void*) {
    PkgRecordsStruct &Struct = GetStruct(Self,"ShortDesc");
-   return (Struct.Last != 0) ? CppPyLocaleString(Struct.Last->ShortDesc()) : 0;
+   if (Struct.Last == 0)
+      return 0;
+   return Struct.Field(":ShortDesc", [&] { return CppPyLocaleString(Struct.Last->ShortDesc()); });
 }
 static PyObject *PkgRecordsGetLongDesc(PyObject *Self,void*) {
    PkgRecordsStruct &Struct = GetStruct(Self,"LongDesc");
-   return (Struct.Last != 0) ? CppPyLocaleString(Struct.Last->LongDesc()) : 0;
+   if (Struct.Last == 0)
+      return 0;
+   return Struct.Field(":LongDesc", [&] { return CppPyLocaleString(Struct.Last->LongDesc()); });
 }
 static PyObject *PkgRecordsGetName(PyObject *Self,void*) {
    PkgRecordsStruct &Struct = GetStruct(Self,"Name");
-   return (Struct.Last != 0) ? CppPyString(Struct.Last->Name()) : 0;
+   if (Struct.Last == 0)
+      return 0;
+   return Struct.Field(":Name", [&] { return CppPyString(Struct.Last->Name()); });
 }
 static PyObject *PkgRecordsGetHomepage(PyObject *Self,void*) {
    PkgRecordsStruct &Struct = GetStruct(Self,"Homepage");
-   return (Struct.Last != 0) ? CppPyString(Struct.Last->Homepage()) : 0;
+   if (Struct.Last == 0)
+      return 0;
+   return Struct.Field(":Homepage", [&] { return CppPyString(Struct.Last->Homepage()); });
 }
 static PyObject *PkgRecordsGetRecord(PyObject *Self,void*) {
    const char *start, *stop;
    PkgRecordsStruct &Struct = GetStruct(Self,"Record");
    if (Struct.Last == 0)
       return 0;
-   Struct.Last->GetRec(start, stop);
-   return PyString_FromStringAndSize(start,stop-start);
+   return Struct.Field(":Record", [&] {
+      Struct.Last->GetRec(start, stop);
+      return PyString_FromStringAndSize(start,stop-start);
+   });
 }
 static PyGetSetDef PkgRecordsGetSet[] = {
    {"filename",PkgRecordsGetFileName,0,
@@ -190,7 +333,14 @@ static int PkgRecordsContains(PyObject *Self,PyObject *Arg)
    if (Name == nullptr)
       return -1;
 
-   return !Struct.Last->RecordField(Name).empty();
+   PyObject *Value = Struct.Field(Name, [&] {
+      return CppPyString(Struct.Last->RecordField(Name));
+   });
+   if (Value == nullptr)
+      return -1;
+   int Result = PyObject_IsTrue(Value);
+   Py_DECREF(Value);
+   return Result;
 }
 
 static PyObject *PkgRecordsMap(PyObject *Self,PyObject *Arg)
@@ -203,7 +353,9 @@ static PyObject *PkgRecordsMap(PyObject *Self,PyObject *Arg)
    if (Name == nullptr)
       return nullptr;
 
-   return CppPyString(Struct.Last->RecordField(Name));
+   return Struct.Field(Name, [&] {
+      return CppPyString(Struct.Last->RecordField(Name));
+   });
 }
 
 
@@ -1,10 +1,42 @@
 #include <apt-pkg/pkgrecords.h>
 
+#include <Python.h>
+#include <string>
+#include <utility>
+#include <vector>
+
 struct PkgRecordsStruct
 {
    pkgRecords Records;
    pkgRecords::Parser *Last;
+   // The version file Last is positioned at
+   pkgCache::VerFile *LastFile;
+   // Values of fields read from the current record, dropped on lookup
+   std::vector<std::pair<std::string,PyObject *> > Fields;
 
-   PkgRecordsStruct(pkgCache *Cache) : Records(*Cache), Last(0) {};
+   PkgRecordsStruct(pkgCache *Cache) : Records(*Cache), Last(0), LastFile(0) {};
    PkgRecordsStruct() : Records(*(pkgCache *)0) {abort();};  // G++ Bug..
+   ~PkgRecordsStruct() { ClearFields(); }
+
+   void ClearFields() {
+      for (auto &Field : Fields)
+	 Py_DECREF(Field.second);
+      Fields.clear();
+   }
+
+   /* Return a new reference to the value for Key in the current record,
+      creating it with Make() on the first access after a lookup. */
+   template<typename F> PyObject *Field(const char *Key, F Make) {
+      for (auto const &Field : Fields)
+	 if (Field.first == Key) {
+	    Py_INCREF(Field.second);
+	    return Field.second;
+	 }
+      PyObject *Value = Make();
+      if (Value != 0) {
+	 Py_INCREF(Value);
+	 Fields.push_back(std::make_pair(std::string(Key),Value));
+      }
+      return Value;
+   }
 };
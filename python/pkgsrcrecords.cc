@@ -12,8 +12,17 @@
 #include "apt_pkgmodule.h"
 
 #include <apt-pkg/sourcelist.h>
+#include <apt-pkg/srcrecords.h>
+#include <apt-pkg/indexfile.h>
+#include <apt-pkg/metaindex.h>
+#include <apt-pkg/error.h>
 
 #include <Python.h>
+
+#include <algorithm>
+#include <string>
+#include <unordered_map>
+#include <vector>
 									/*}}}*/
 
 // PkgSrcRecordFiles Class						/*{{{*/
@@ -141,17 +150,140 @@ PyTypeObject PySourceRecordFiles_Type =
 
 struct PkgSrcRecordsStruct
 {
+   // A record, identified by its parser and its offset in the index file
+   typedef std::pair<size_t, unsigned long> Position;
+
    pkgSourceList List;
-   pkgSrcRecords *Records;
+   std::vector<pkgSrcRecords::Parser *> Files;
    pkgSrcRecords::Parser *Last;
 
-   PkgSrcRecordsStruct() : Last(0) {
+   // The position of the current record, if any
+   bool HaveCursor;
+   Position Cursor;
+   // Whether BuildIndex() or lookup_many() moved the parsers off the cursor
+   bool Moved;
+
+   // Source and binary names to the records mentioning them, built on use
+   bool Indexed;
+   std::unordered_map<std::string, std::vector<Position> > Index;
+
+   PkgSrcRecordsStruct() : Last(0), HaveCursor(false), Moved(false), Indexed(false) {
       List.ReadMainList();
-      Records = new pkgSrcRecords(List);
+      // Like pkgSrcRecords, but we need access to the parsers
+      for (auto I = List.begin(); I != List.end(); ++I) {
+	 std::vector<pkgIndexFile *> *Indexes = (*I)->GetIndexFiles();
+	 for (auto J = Indexes->begin(); J != Indexes->end(); ++J) {
+	    _error->PushToStack();
+	    pkgSrcRecords::Parser *P = (*J)->CreateSrcParser();
+	    bool const newError = _error->PendingError();
+	    _error->MergeWithStack();
+	    if (newError == true)
+	       return;
+	    if (P != 0)
+	       Files.push_back(P);
+	 }
+      }
+      if (Files.empty() == true)
+	 _error->Error("You must put some 'deb-src' URIs in your sources.list");
    };
    ~PkgSrcRecordsStruct() {
-      delete Records;
+      for (auto P : Files)
+	 delete P;
    };
+
+   void Restart() {
+      for (auto P : Files)
+	 P->Restart();
+      HaveCursor = false;
+      Moved = false;
+   }
+
+   // Move to the given record
+   pkgSrcRecords::Parser *Jump(Position const &Pos) {
+      if (Files[Pos.first]->Jump(Pos.second) == false)
+	 return 0;
+      return Files[Pos.first];
+   }
+
+   /* Put the parser of the current record back in place if it was moved,
+      so that it does not seek backwards on every step. */
+   bool Return() {
+      if (Moved == false || HaveCursor == false)
+	 return true;
+      if (Jump(Cursor) == 0)
+	 return false;
+      Moved = false;
+      return true;
+   }
+
+   // Move to the record after the cursor, like pkgSrcRecords::Step()
+   pkgSrcRecords::Parser *Step() {
+      size_t Current = 0;
+      if (HaveCursor == true) {
+	 Current = Cursor.first;
+	 if (Return() == false)
+	    return 0;
+      } else if (Files.empty() == false) {
+	 Files[0]->Restart();
+      }
+
+      for (; Current < Files.size(); Current++) {
+	 if (Files[Current]->Step() == true) {
+	    HaveCursor = true;
+	    Cursor = Position(Current, Files[Current]->Offset());
+	    return Files[Current];
+	 }
+	 if (Current + 1 < Files.size())
+	    Files[Current + 1]->Restart();
+      }
+      return 0;
+   }
+
+   /* Read all index files once and record where each source package and
+      each binary package built by a source package is mentioned. */
+   void BuildIndex() {
+      if (Indexed == true)
+	 return;
+      for (size_t I = 0; I < Files.size(); I++) {
+	 pkgSrcRecords::Parser *P = Files[I];
+	 P->Restart();
+	 while (P->Step() == true) {
+	    Position const Pos(I, P->Offset());
+	    std::string const Package = P->Package();
+	    Index[Package].push_back(Pos);
+	    for (const char **B = P->Binaries(); B != 0 && *B != 0; ++B) {
+	       if (Package == *B)
+		  continue;
+	       std::vector<Position> &Hits = Index[*B];
+	       if (Hits.empty() == true || Hits.back() != Pos)
+		  Hits.push_back(Pos);
+	    }
+	 }
+	 P->Restart();
+      }
+      Indexed = true;
+      Moved = true;
+   }
+
+   // Find the first record for Name after the cursor, like pkgSrcRecords::Find()
+   pkgSrcRecords::Parser *Find(const char *Name) {
+      BuildIndex();
+      auto Hits = Index.find(Name);
+      if (Hits == Index.end())
+	 return 0;
+      auto Hit = Hits->second.begin();
+      if (HaveCursor == true)
+	 Hit = std::upper_bound(Hits->second.begin(), Hits->second.end(), Cursor);
+      if (Hit == Hits->second.end())
+	 return 0;
+      pkgSrcRecords::Parser *P = Jump(*Hit);
+      if (P != 0) {
+	 HaveCursor = true;
+	 Cursor = *Hit;
+	 Moved = false;
+      }
+      return P;
+   }
 };
 
 
@@ -172,9 +304,9 @@ static PyObject *PkgSrcRecordsLookup(PyObject *Self,PyObject *Args)
    if (PyArg_ParseTuple(Args,"s",&Name) == 0)
       return 0;
 
-   Struct.Last = Struct.Records->Find(Name, false);
+   Struct.Last = Struct.Find(Name);
    if (Struct.Last == 0) {
-      Struct.Records->Restart();
+      Struct.Restart();
       Py_INCREF(Py_None);
       return HandleErrors(Py_None);
    }
@@ -182,6 +314,62 @@ static PyObject *PkgSrcRecordsLookup(PyObject *Self,PyObject *Args)
    return PyBool_FromLong(1);
 }
 
+static char *doc_PkgSrcRecordsLookupMany =
+    "lookup_many(names: list) -> dict\n\n"
+    "Look up all records mentioning the given source or binary package\n"
+    "names and return a dict mapping each name to a list of the raw\n"
+    "records, in the order lookup() would find them. This does not\n"
+    "change the position used by lookup() and step().";
+static PyObject *PkgSrcRecordsLookupMany(PyObject *Self,PyObject *Args)
+{
+   PkgSrcRecordsStruct &Struct = GetCpp<PkgSrcRecordsStruct>(Self);
+
+   PyObject *NamesObj;
+   if (PyArg_ParseTuple(Args,"O",&NamesObj) == 0)
+      return 0;
+   PyObject *Names = PySequence_Fast(NamesObj,"names must be a sequence");
+   if (Names == 0)
+      return 0;
+
+   Struct.BuildIndex();
+
+   PyObject *Dict = PyDict_New();
+   for (Py_ssize_t I = 0; Dict != 0 && I < PySequence_Fast_GET_SIZE(Names); I++) {
+      PyObject *NameObj = PySequence_Fast_GET_ITEM(Names,I);
+      const char *Name = PyObject_AsString(NameObj);
+      PyObject *List = (Name != 0) ? PyList_New(0) : 0;
+      if (List == 0) {
+	 Py_CLEAR(Dict);
+	 break;
+      }
+      auto Hits = Struct.Index.find(Name);
+      if (Hits != Struct.Index.end()) {
+	 for (auto const &Hit : Hits->second) {
+	    pkgSrcRecords::Parser *P = Struct.Jump(Hit);
+	    if (P == 0)
+	       continue;
+	    PyObject *Record = CppPyString(P->AsStr());
+	    if (Record == 0 || PyList_Append(List,Record) == -1) {
+	       Py_XDECREF(Record);
+	       Py_CLEAR(List);
+	       break;
+	    }
+	    Py_DECREF(Record);
+	 }
+      }
+      if (List == 0 || PyDict_SetItem(Dict,NameObj,List) == -1)
+	 Py_CLEAR(Dict);
+      Py_XDECREF(List);
+   }
+   Py_DECREF(Names);
+   // BuildIndex() and Jump() have moved the parsers even on errors.
+   Struct.Moved = true;
+
+   if (Dict == 0)
+      return 0;
+   return HandleErrors(Dict);
+}
+
 static char *doc_PkgSrcRecordsRestart =
     "restart()\n\n"
     "Restart the lookup process. This moves the parser to the first\n"
@@ -193,7 +381,7 @@ static PyObject *PkgSrcRecordsRestart(PyObject *Self,PyObject *Args)
    if (PyArg_ParseTuple(Args,"") == 0)
       return 0;
 
-   Struct.Records->Restart();
+   Struct.Restart();
 
    Py_INCREF(Py_None);
    return HandleErrors(Py_None);
@@ -212,9 +400,9 @@ static PyObject *PkgSrcRecordsStep(PyObject *Self,PyObject *Args)
    if (PyArg_ParseTuple(Args,"") == 0)
       return 0;
 
-   Struct.Last = (pkgSrcRecords::Parser*)Struct.Records->Step();
+   Struct.Last = Struct.Step();
    if (Struct.Last == 0) {
-      Struct.Records->Restart();
+      Struct.Restart();
       Py_INCREF(Py_None);
       return HandleErrors(Py_None);
    }
@@ -225,6 +413,7 @@ static PyObject *PkgSrcRecordsStep(PyObject *Self,PyObject *Args)
 static PyMethodDef PkgSrcRecordsMethods[] =
 {
    {"lookup",PkgSrcRecordsLookup,METH_VARARGS,doc_PkgSrcRecordsLookup},
+   {"lookup_many",PkgSrcRecordsLookupMany,METH_VARARGS,doc_PkgSrcRecordsLookupMany},
    {"restart",PkgSrcRecordsRestart,METH_VARARGS,doc_PkgSrcRecordsRestart},
    {"step",PkgSrcRecordsStep,METH_VARARGS,doc_PkgSrcRecordsStep},
    {}
@@ -238,6 +427,8 @@ static inline PkgSrcRecordsStruct &GetStruct(PyObject *Self,char *name) {
    PkgSrcRecordsStruct &Struct = GetCpp<PkgSrcRecordsStruct>(Self);
    if (Struct.Last == 0)
       PyErr_SetString(PyExc_AttributeError,name);
+   else
+      Struct.Return();
    return Struct;
 }
 
@@ -266,9 +457,13 @@ static PyObject *PkgSrcRecordsGetBinaries(PyObject *Self,void*) {
    if (Struct.Last == 0)
       return 0;
    PyObject *List = PyList_New(0);
-   for(const char **b = Struct.Last->Binaries(); *b != 0; ++b)
-      PyList_Append(List, CppPyString(*b));
-   return List; // todo
+   for(const char **b = Struct.Last->Binaries(); List != 0 && *b != 0; ++b) {
+      PyObject *v = CppPyString(*b);
+      if (v == 0 || PyList_Append(List, v) == -1)
+	 Py_CLEAR(List);
+      Py_XDECREF(v);
+   }
+   return List;
 }
 static PyObject *PkgSrcRecordsGetIndex(PyObject *Self,void*) {
    PkgSrcRecordsStruct &Struct = GetStruct(Self,"Index");
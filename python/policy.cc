@@ -22,6 +22,43 @@
 #include "apt_pkgmodule.h"
 #include "generic.h"
 #include <apt-pkg/policy.h>
+#include <apt-pkg/error.h>
+#include <apt-pkg/fileutl.h>
+#include <apt-pkg/strutl.h>
+#include <apt-pkg/tagfile.h>
+
+#include <chrono>
+#include <vector>
+#include <fnmatch.h>
+#include <regex.h>
+
+/* Statistics about a single package name or pattern of a pin, filled in
+   by Policy.compile(). */
+struct PinPatternStat {
+    std::string package;
+    const char *kind;
+    unsigned long matches;
+    double seconds;
+};
+
+/* Statistics about a single preferences file read through
+   Policy.read_pinfile() or Policy.read_pindir(). */
+struct PinStat {
+    std::string file;
+    bool result;
+    double seconds;
+    std::vector<PinPatternStat> pins;
+};
+
+struct PyPolicyObject : public CppPyObject<pkgPolicy*> {
+    std::vector<PinStat> *stats;
+};
+
+static void policy_dealloc(PyObject *self) {
+    delete ((PyPolicyObject *)self)->stats;
+    ((PyPolicyObject *)self)->stats = NULL;
+    CppDeallocPtr<pkgPolicy*>(self);
+}
 
 static PyObject *policy_new(PyTypeObject *type,PyObject *Args,
                                   PyObject *kwds) {
@@ -103,10 +140,131 @@ PyObject *policy_get_candidate_ver(PyObject *self, PyObject *arg) {
     }
 }
 
+static pkgCache *policy_get_cache(PyObject *self) {
+    return GetCpp<pkgCache *>(GetOwner<pkgPolicy *>(self));
+}
+
+static char *policy_candidates_doc =
+    "candidates([packages: Sequence[apt_pkg.Package]]) -> array.array\n\n"
+    "Return the IDs of the candidate versions of the given packages as an\n"
+    "array of ints, -1 meaning no candidate. Without an argument, the\n"
+    "array covers the whole cache and is indexed by package ID.";
+
+static PyObject *policy_candidates(PyObject *self, PyObject *args) {
+    PyObject *packages = Py_None;
+    if (PyArg_ParseTuple(args, "|O", &packages) == 0)
+        return 0;
+    pkgPolicy *policy = GetCpp<pkgPolicy *>(self);
+    pkgCache *cache = policy_get_cache(self);
+    std::vector<int> result;
+
+    if (packages == Py_None) {
+        result.resize(cache->HeaderP->PackageCount, -1);
+        for (auto pkg = cache->PkgBegin(); !pkg.end(); ++pkg) {
+            pkgCache::VerIterator ver = policy->GetCandidateVer(pkg);
+            if (!ver.end())
+                result[pkg->ID] = ver->ID;
+        }
+        return HandleErrors(IntVectorToArray(result));
+    }
+
+    PyObject *seq = PySequence_Fast(packages, "packages must be a sequence");
+    if (seq == 0)
+        return 0;
+    Py_ssize_t len = PySequence_Fast_GET_SIZE(seq);
+    result.reserve(len);
+    for (Py_ssize_t i = 0; i < len; i++) {
+        PyObject *item = PySequence_Fast_GET_ITEM(seq, i);
+        if (!PyObject_TypeCheck(item, &PyPackage_Type)) {
+            Py_DECREF(seq);
+            PyErr_SetString(PyExc_TypeError, "Argument must be a sequence of Package().");
+            return 0;
+        }
+        pkgCache::PkgIterator pkg = GetCpp<pkgCache::PkgIterator>(item);
+        if (pkg.Cache() != cache) {
+            Py_DECREF(seq);
+            PyErr_SetString(PyAptCacheMismatchError, "Object of different cache passed as argument to apt_pkg.Policy method");
+            return 0;
+        }
+        pkgCache::VerIterator ver = policy->GetCandidateVer(pkg);
+        result.push_back(ver.end() ? -1 : (int) ver->ID);
+    }
+    Py_DECREF(seq);
+    return HandleErrors(IntVectorToArray(result));
+}
+
+static char *policy_priorities_doc =
+    "priorities([versions: Sequence[apt_pkg.Version]]) -> array.array\n\n"
+    "Return the pin priorities of the given versions as an array of ints.\n"
+    "Without an argument, the array covers the whole cache and is indexed\n"
+    "by version ID.";
+
+static PyObject *policy_priorities(PyObject *self, PyObject *args) {
+    PyObject *versions = Py_None;
+    if (PyArg_ParseTuple(args, "|O", &versions) == 0)
+        return 0;
+    pkgPolicy *policy = GetCpp<pkgPolicy *>(self);
+    pkgCache *cache = policy_get_cache(self);
+    std::vector<int> result;
+
+    if (versions == Py_None) {
+        result.resize(cache->HeaderP->VersionCount, 0);
+        for (auto pkg = cache->PkgBegin(); !pkg.end(); ++pkg)
+            for (auto ver = pkg.VersionList(); !ver.end(); ++ver)
+                result[ver->ID] = policy->GetPriority(ver);
+        return HandleErrors(IntVectorToArray(result));
+    }
+
+    PyObject *seq = PySequence_Fast(versions, "versions must be a sequence");
+    if (seq == 0)
+        return 0;
+    Py_ssize_t len = PySequence_Fast_GET_SIZE(seq);
+    result.reserve(len);
+    for (Py_ssize_t i = 0; i < len; i++) {
+        PyObject *item = PySequence_Fast_GET_ITEM(seq, i);
+        if (!PyObject_TypeCheck(item, &PyVersion_Type)) {
+            Py_DECREF(seq);
+            PyErr_SetString(PyExc_TypeError, "Argument must be a sequence of Version().");
+            return 0;
+        }
+        pkgCache::VerIterator ver = GetCpp<pkgCache::VerIterator>(item);
+        if (ver.Cache() != cache) {
+            Py_DECREF(seq);
+            PyErr_SetString(PyAptCacheMismatchError, "Object of different cache passed as argument to apt_pkg.Policy method");
+            return 0;
+        }
+        result.push_back(policy->GetPriority(ver));
+    }
+    Py_DECREF(seq);
+    return HandleErrors(IntVectorToArray(result));
+}
+
+/* Read a preferences file with ReadPinFile(), recording how long it took. */
+static bool policy_read_pinfile_stat(pkgPolicy &policy, const std::string &file,
+                                     std::vector<PinStat> &stats) {
+    auto start = std::chrono::steady_clock::now();
+    bool res = ReadPinFile(policy, file);
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    PinStat stat;
+    stat.file = file.empty() ? _config->FindFile("Dir::Etc::Preferences") : file;
+    stat.result = res;
+    stat.seconds = elapsed.count();
+    stats.push_back(stat);
+    return res;
+}
+
+static std::vector<PinStat> &policy_get_stats(PyObject *self) {
+    PyPolicyObject *obj = (PyPolicyObject *)self;
+    if (obj->stats == NULL)
+        obj->stats = new std::vector<PinStat>();
+    return *obj->stats;
+}
+
 static char *policy_read_pinfile_doc =
     "read_pinfile(filename: str) -> bool\n\n"
     "Read the pin file given by filename (e.g. '/etc/apt/preferences')\n"
-    "and add it to the policy.";
+    "and add it to the policy. The time spent reading it is recorded and\n"
+    "can be retrieved using stats().";
 
 static PyObject *policy_read_pinfile(PyObject *self, PyObject *arg) {
     PyApt_Filename name;
@@ -114,25 +272,178 @@ static PyObject *policy_read_pinfile(PyObject *self, PyObject *arg) {
         return 0;
     pkgPolicy *policy = GetCpp<pkgPolicy *>(self);
 
-    return PyBool_FromLong(ReadPinFile(*policy, name));
+    return PyBool_FromLong(policy_read_pinfile_stat(*policy, name.path,
+                                                    policy_get_stats(self)));
 }
 
 #if (APT_PKG_MAJOR > 4 || (APT_PKG_MAJOR >= 4 && APT_PKG_MINOR >= 8))
 static char *policy_read_pindir_doc =
     "read_pindir(dirname: str) -> bool\n\n"
     "Read the pin files in the given dir (e.g. '/etc/apt/preferences.d')\n"
-    "and add them to the policy.";
+    "and add them to the policy. The time spent reading each file is\n"
+    "recorded and can be retrieved using stats(). Like ReadPinDir(), a\n"
+    "file which can not be read does not stop the others from being read.";
 
 static PyObject *policy_read_pindir(PyObject *self, PyObject *arg) {
     PyApt_Filename name;
     if (!name.init(arg))
         return 0;
     pkgPolicy *policy = GetCpp<pkgPolicy *>(self);
+    std::vector<PinStat> &stats = policy_get_stats(self);
+
+    // Let ReadPinDir() handle the default and missing directories, and
+    // time ReadPinFile() for each file it would read otherwise.
+    if (name.path[0] == '\0' || !DirectoryExists(name.path))
+        return PyBool_FromLong(ReadPinDir(*policy, name.path));
+
+    _error->PushToStack();
+    std::vector<std::string> const list = GetListOfFilesInDir(name.path, "pref", true, true);
+    bool const pending = _error->PendingError();
+    _error->MergeWithStack();
+    if (pending)
+        Py_RETURN_FALSE;
 
-    return PyBool_FromLong(ReadPinDir(*policy, name));
+    bool res = true;
+    for (auto const &file : list)
+        if (!policy_read_pinfile_stat(*policy, file, stats))
+            res = false;
+    return PyBool_FromLong(res);
 }
 #endif
 
+/* Read the package names and patterns of the pins in a preferences file,
+   the way ReadPinFile() splits the Package field. */
+static bool policy_read_pin_names(const std::string &file,
+                                  std::vector<std::string> &names) {
+    FileFd Fd;
+    if (!Fd.Open(file, FileFd::ReadOnly))
+        return false;
+    pkgTagFile TF(&Fd, pkgTagFile::SUPPORT_COMMENTS);
+    if (Fd.IsOpen() == false || Fd.Failed())
+        return false;
+    pkgTagSection Tags;
+    while (TF.Step(Tags)) {
+        if (Tags.Exists("Package") == false)
+            continue;
+        for (auto const &name : VectorizeString(Tags.FindS("Package"), ' '))
+            if (!name.empty())
+                names.push_back(name);
+    }
+    return !_error->PendingError();
+}
+
+/* Match a single name or pattern against the package names of the cache,
+   the way pkgPolicy::CreatePin() does, and time it. */
+static PinPatternStat policy_match_pin(pkgCache &cache, const std::string &name) {
+    PinPatternStat stat = {name, "exact", 0, 0};
+    auto start = std::chrono::steady_clock::now();
+    if (name == "*") {
+        stat.kind = "default";
+    } else if (name.size() > 2 && name[0] == '/' && name[name.size() - 1] == '/') {
+        stat.kind = "regex";
+        regex_t pattern;
+        if (regcomp(&pattern, name.substr(1, name.size() - 2).c_str(),
+                    REG_EXTENDED | REG_ICASE | REG_NOSUB) == 0) {
+            for (auto grp = cache.GrpBegin(); !grp.end(); ++grp)
+                if (regexec(&pattern, grp.Name(), 0, 0, 0) == 0)
+                    stat.matches++;
+            regfree(&pattern);
+        }
+    } else if (name.find_first_of("*?[") != std::string::npos) {
+        stat.kind = "glob";
+        for (auto grp = cache.GrpBegin(); !grp.end(); ++grp)
+            if (fnmatch(name.c_str(), grp.Name(), 0) == 0)
+                stat.matches++;
+    } else if (!cache.FindGrp(name.substr(0, name.find(':'))).end()) {
+        stat.matches = 1;
+    }
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    stat.seconds = elapsed.count();
+    return stat;
+}
+
+static char *policy_compile_doc =
+    "compile() -> int\n\n"
+    "Sort the pins of the files read by read_pinfile() and read_pindir()\n"
+    "into exact names, globs and regular expressions, and match each of\n"
+    "them against the package names of the cache once. The number of\n"
+    "matches and the time spent on each pin are reported by stats().\n"
+    "Return the number of pins.";
+
+static PyObject *policy_compile(PyObject *self, PyObject *args) {
+    if (PyArg_ParseTuple(args, "") == 0)
+        return 0;
+    pkgCache *cache = policy_get_cache(self);
+    std::vector<PinStat> &stats = policy_get_stats(self);
+    unsigned long long count = 0;
+
+    for (auto &stat : stats) {
+        stat.pins.clear();
+        std::vector<std::string> names;
+        if (!stat.result || !policy_read_pin_names(stat.file, names))
+            continue;
+        for (auto const &name : names)
+            stat.pins.push_back(policy_match_pin(*cache, name));
+        count += stat.pins.size();
+    }
+    if (_error->PendingError())
+        return HandleErrors();
+    return MkPyNumber(count);
+}
+
+static char *policy_stats_doc =
+    "stats() -> list\n\n"
+    "Return a list of dicts describing each preferences file read by\n"
+    "read_pinfile() or read_pindir() on this object: the 'file', whether\n"
+    "reading it succeeded ('result'), the 'time' in seconds spent\n"
+    "reading it and creating its pins, and its 'pins' as of the last\n"
+    "compile(): dicts with the 'package' name or pattern, its 'kind'\n"
+    "('exact', 'glob', 'regex' or 'default'), the number of package\n"
+    "names it 'matches' and the 'time' spent matching it.";
+
+static PyObject *policy_stats(PyObject *self, PyObject *args) {
+    if (PyArg_ParseTuple(args, "") == 0)
+        return 0;
+    std::vector<PinStat> &stats = policy_get_stats(self);
+    PyObject *list = PyList_New(0);
+    if (list == 0)
+        return 0;
+    for (auto const &stat : stats) {
+        PyObject *pins = PyList_New(0);
+        if (pins == 0) {
+            Py_DECREF(list);
+            return 0;
+        }
+        for (auto const &pin : stat.pins) {
+            PyObject *item = Py_BuildValue("{s:s#,s:s,s:k,s:d}",
+                                           "package", pin.package.c_str(),
+                                           (Py_ssize_t) pin.package.size(),
+                                           "kind", pin.kind,
+                                           "matches", pin.matches,
+                                           "time", pin.seconds);
+            if (item == 0 || PyList_Append(pins, item) == -1) {
+                Py_XDECREF(item);
+                Py_DECREF(pins);
+                Py_DECREF(list);
+                return 0;
+            }
+            Py_DECREF(item);
+        }
+        PyObject *item = Py_BuildValue("{s:N,s:N,s:d,s:N}",
+                                       "file", CppPyPath(stat.file),
+                                       "result", PyBool_FromLong(stat.result),
+                                       "time", stat.seconds,
+                                       "pins", pins);
+        if (item == 0 || PyList_Append(list, item) == -1) {
+            Py_XDECREF(item);
+            Py_DECREF(list);
+            return 0;
+        }
+        Py_DECREF(item);
+    }
+    return list;
+}
+
 static char *policy_create_pin_doc =
     "create_pin(type: str, pkg: str, data: str, priority: int)\n\n"
     "Create a pin for the policy. The parameter 'type' refers to one of the\n"
@@ -180,6 +491,8 @@ static PyMethodDef policy_methods[] = {
     {"set_priority",policy_set_priority,METH_VARARGS,policy_set_priority_doc},
     {"get_candidate_ver",(PyCFunction)policy_get_candidate_ver,METH_O,
      policy_get_candidate_ver_doc},
+    {"candidates",policy_candidates,METH_VARARGS,policy_candidates_doc},
+    {"priorities",policy_priorities,METH_VARARGS,policy_priorities_doc},
     {"read_pinfile",(PyCFunction)policy_read_pinfile,METH_O,
      policy_read_pinfile_doc},
 #if (APT_PKG_MAJOR > 4 || (APT_PKG_MAJOR >= 4 && APT_PKG_MINOR >= 8))
@@ -188,6 +501,8 @@ static PyMethodDef policy_methods[] = {
 #endif
     {"create_pin",policy_create_pin,METH_VARARGS,policy_create_pin_doc},
     {"init_defaults",policy_init_defaults,METH_VARARGS,policy_init_defaults_doc},
+    {"compile",policy_compile,METH_VARARGS,policy_compile_doc},
+    {"stats",policy_stats,METH_VARARGS,policy_stats_doc},
     {}
 };
 
@@ -201,10 +516,10 @@ static char *policy_doc =
 PyTypeObject PyPolicy_Type = {
     PyVarObject_HEAD_INIT(&PyType_Type, 0)
     "apt_pkg.Policy",                    // tp_name
-    sizeof(CppPyObject<pkgPolicy*>),// tp_basicsize
+    sizeof(PyPolicyObject),              // tp_basicsize
     0,                                   // tp_itemsize
     // Methods
-    CppDeallocPtr<pkgPolicy*>,      // tp_dealloc
+    policy_dealloc,                      // tp_dealloc
     0,                                   // tp_print
     0,                                   // tp_getattr
     0,                                   // tp_setattr
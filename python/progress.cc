@@ -9,6 +9,14 @@
 #include <iostream>
 #include <sys/types.h>
 #include <sys/wait.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <errno.h>
+#include <time.h>
+#include <stdint.h>
+#include <unistd.h>
 #include <map>
 #include <utility>
 #include <apt-pkg/acquire-item.h>
@@ -112,6 +120,147 @@ void PyOpProgress::Done()
 
 // apt interface
 
+const char *PyFetchStats::Names[] = {
+   "current_bytes", "total_bytes", "fetched_bytes", "current_cps",
+   "elapsed_time", "current_items", "total_items", "done_items",
+   "failed_items", "hit_items", "cache_hits", "cache_misses"
+};
+
+void PyFetchStats::Update(pkgAcquireStatus const &Status)
+{
+   Values[CurrentBytes] = Status.CurrentBytes;
+   Values[TotalBytes] = Status.TotalBytes;
+   Values[FetchedBytes] = Status.FetchedBytes;
+   Values[CurrentCPS] = Status.CurrentCPS;
+   Values[ElapsedTime] = Status.ElapsedTime;
+   Values[CurrentItems] = Status.CurrentItems;
+   Values[TotalItems] = Status.TotalItems;
+}
+
+static double FetchNow()
+{
+   struct timespec Now;
+   clock_gettime(CLOCK_REALTIME, &Now);
+   return Now.tv_sec + Now.tv_nsec / 1e9;
+}
+
+PyFetchItemRecord &PyFetchRecorder::Record(pkgAcquire::Item *Owner, double Now)
+{
+   auto Found = Index.find(Owner);
+   if (Found != Index.end())
+      return Items[Found->second];
+
+   PyFetchItemRecord New;
+   New.URI = Owner->DescURI();
+   New.ShortDesc = Owner->ShortDesc();
+   New.Status = PyFetchItemRecord::Pending;
+   // Every pulse registers the queued items, so items not seen by a
+   // pulse yet were queued before run() or since the last pulse.
+   New.Queued = (Pulsed == false && RunStart >= 0) ? RunStart : Now;
+   New.Started = New.FirstByte = New.Finished = -1;
+   New.Bytes = 0;
+   New.Fetches = 0;
+   Index.emplace(Owner, Items.size());
+   Items.push_back(New);
+   return Items.back();
+}
+
+void PyFetchRecorder::Start()
+{
+   std::lock_guard<std::mutex> Guard(Lock);
+   RunStart = FetchNow();
+   Pulsed = false;
+}
+
+void PyFetchRecorder::Fetch(pkgAcquire::ItemDesc &Itm)
+{
+   std::lock_guard<std::mutex> Guard(Lock);
+   double Now = FetchNow();
+   PyFetchItemRecord &R = Record(Itm.Owner, Now);
+   // A new fetch of the same item is a retry or a fallback URI
+   R.URI = Itm.URI;
+   R.Started = Now;
+   R.FirstByte = -1;
+   R.Fetches++;
+}
+
+void PyFetchRecorder::Hit(pkgAcquire::ItemDesc &Itm)
+{
+   if (Stats != 0)
+      Stats->Values[PyFetchStats::HitItems]++;
+   std::lock_guard<std::mutex> Guard(Lock);
+   PyFetchItemRecord &R = Record(Itm.Owner, FetchNow());
+   R.Status = PyFetchItemRecord::Hit;
+   R.Finished = FetchNow();
+   R.Bytes = Itm.Owner->FileSize;
+}
+
+void PyFetchRecorder::Done(pkgAcquire::ItemDesc &Itm)
+{
+   if (Stats != 0)
+      Stats->Values[PyFetchStats::DoneItems]++;
+   std::lock_guard<std::mutex> Guard(Lock);
+   double Now = FetchNow();
+   PyFetchItemRecord &R = Record(Itm.Owner, Now);
+   R.Status = PyFetchItemRecord::Done;
+   R.Finished = Now;
+   R.Bytes = Itm.Owner->FileSize;
+   // Finished before a pulse could see data arrive
+   if (R.FirstByte < 0 && R.Started >= 0 && R.Bytes != 0)
+      R.FirstByte = Now;
+}
+
+void PyFetchRecorder::Fail(pkgAcquire::ItemDesc &Itm)
+{
+   // Idle items are retried
+   if (Itm.Owner->Status == pkgAcquire::Item::StatIdle)
+      return;
+   if (Stats != 0)
+      Stats->Values[PyFetchStats::FailedItems]++;
+   std::lock_guard<std::mutex> Guard(Lock);
+   PyFetchItemRecord &R = Record(Itm.Owner, FetchNow());
+   R.Status = PyFetchItemRecord::Failed;
+   R.Finished = FetchNow();
+   R.Bytes = Itm.Owner->PartialSize;
+}
+
+void PyFetchRecorder::Pulse(pkgAcquireStatus const &Status, pkgAcquire *Owner)
+{
+   if (Stats != 0)
+      Stats->Update(Status);
+   std::lock_guard<std::mutex> Guard(Lock);
+   double Now = FetchNow();
+   for (pkgAcquire::ItemIterator I = Owner->ItemsBegin(); I != Owner->ItemsEnd(); ++I)
+      Record(*I, Now);
+   Pulsed = true;
+   for (pkgAcquire::Worker *W = Owner->WorkersBegin(); W != 0; W = Owner->WorkerStep(W))
+   {
+      if (W->CurrentItem == 0 || W->CurrentItem->CurrentSize <= W->CurrentItem->ResumePoint)
+         continue;
+      PyFetchItemRecord &R = Record(W->CurrentItem->Owner, Now);
+      if (R.FirstByte < 0)
+         R.FirstByte = Now;
+   }
+}
+
+void PyFetchRecorder::Stop(pkgAcquireStatus const &Status)
+{
+   if (Stats != 0)
+      Stats->Update(Status);
+}
+
+void PyFetchRecorder::Forget(pkgAcquire::Item *Owner)
+{
+   std::lock_guard<std::mutex> Guard(Lock);
+   Index.erase(Owner);
+}
+
+void PyFetchRecorder::ForgetAll()
+{
+   std::lock_guard<std::mutex> Guard(Lock);
+   Index.clear();
+}
+
 PyObject *PyFetchProgress::GetDesc(pkgAcquire::ItemDesc *item) {
     if (!pyAcquire && item->Owner && item->Owner->GetOwner()) {
         pyAcquire = PyAcquire_FromCpp(item->Owner->GetOwner(), false, NULL);
@@ -173,6 +322,8 @@ void PyFetchProgress::UpdateStatus(pkgAcquire::ItemDesc &Itm, int status)
 
 void PyFetchProgress::IMSHit(pkgAcquire::ItemDesc &Itm)
 {
+   if (Recorder != 0)
+      Recorder->Hit(Itm);
    PyCbObj_END_ALLOW_THREADS
    if (PyObject_HasAttrString(callbackInst, "ims_hit"))
        RunSimpleCallback("ims_hit", TUPLEIZE(GetDesc(&Itm)));
@@ -183,6 +334,8 @@ void PyFetchProgress::IMSHit(pkgAcquire::ItemDesc &Itm)
 
 void PyFetchProgress::Fetch(pkgAcquire::ItemDesc &Itm)
 {
+   if (Recorder != 0)
+      Recorder->Fetch(Itm);
    PyCbObj_END_ALLOW_THREADS
    if (PyObject_HasAttrString(callbackInst, "fetch"))
        RunSimpleCallback("fetch", TUPLEIZE(GetDesc(&Itm)));
@@ -193,6 +346,8 @@ void PyFetchProgress::Fetch(pkgAcquire::ItemDesc &Itm)
 
 void PyFetchProgress::Done(pkgAcquire::ItemDesc &Itm)
 {
+   if (Recorder != 0)
+      Recorder->Done(Itm);
    PyCbObj_END_ALLOW_THREADS
    if (PyObject_HasAttrString(callbackInst, "done"))
        RunSimpleCallback("done", TUPLEIZE(GetDesc(&Itm)));
@@ -203,6 +358,8 @@ void PyFetchProgress::Done(pkgAcquire::ItemDesc &Itm)
 
 void PyFetchProgress::Fail(pkgAcquire::ItemDesc &Itm)
 {
+   if (Recorder != 0)
+      Recorder->Fail(Itm);
    PyCbObj_END_ALLOW_THREADS
    if (PyObject_HasAttrString(callbackInst, "fail")) {
        RunSimpleCallback("fail", TUPLEIZE(GetDesc(&Itm)));
@@ -233,6 +390,8 @@ void PyFetchProgress::Start()
 {
    //std::cout << "Start" << std::endl;
    pkgAcquireStatus::Start();
+   if (Recorder != 0)
+      Recorder->Start();
 
 
    RunSimpleCallback("start");
@@ -254,6 +413,8 @@ void PyFetchProgress::Stop()
    PyCbObj_END_ALLOW_THREADS
    //std::cout << "Stop" << std::endl;
    pkgAcquireStatus::Stop();
+   if (Recorder != 0)
+      Recorder->Stop(*this);
    RunSimpleCallback("stop");
 }
 
@@ -261,6 +422,8 @@ bool PyFetchProgress::Pulse(pkgAcquire * Owner)
 {
    PyCbObj_END_ALLOW_THREADS
    pkgAcquireStatus::Pulse(Owner);
+   if (Recorder != 0)
+      Recorder->Pulse(*this, Owner);
 
    //std::cout << "Pulse" << std::endl;
    if(callbackInst == 0) {
@@ -276,6 +439,13 @@ bool PyFetchProgress::Pulse(pkgAcquire * Owner)
    setattr(callbackInst, "elapsed_time", "N", MkPyNumber(ElapsedTime));
    setattr(callbackInst, "current_items", "N", MkPyNumber(CurrentItems));
    setattr(callbackInst, "total_items", "N", MkPyNumber(TotalItems));
+   if (Recorder != 0 && Recorder->Stats != 0) {
+      PyFetchStats const &Stats = *Recorder->Stats;
+      setattr(callbackInst, "cache_hits", "N",
+              MkPyNumber(Stats.Values[PyFetchStats::CacheHits]));
+      setattr(callbackInst, "cache_misses", "N",
+              MkPyNumber(Stats.Values[PyFetchStats::CacheMisses]));
+   }
 
    // New style
    if (!PyObject_HasAttrString(callbackInst, "updateStatus")) {
@@ -305,6 +475,195 @@ bool PyFetchProgress::Pulse(pkgAcquire * Owner)
 
 
 
+// struct progress interface
+
+void PyFetchStructProgress::IMSHit(pkgAcquire::ItemDesc &Itm)
+{
+   if (Recorder != 0)
+      Recorder->Hit(Itm);
+}
+
+void PyFetchStructProgress::Fetch(pkgAcquire::ItemDesc &Itm)
+{
+   if (Recorder != 0)
+      Recorder->Fetch(Itm);
+}
+
+void PyFetchStructProgress::Done(pkgAcquire::ItemDesc &Itm)
+{
+   if (Recorder != 0)
+      Recorder->Done(Itm);
+}
+
+void PyFetchStructProgress::Fail(pkgAcquire::ItemDesc &Itm)
+{
+   if (Recorder != 0)
+      Recorder->Fail(Itm);
+}
+
+bool PyFetchStructProgress::Pulse(pkgAcquire *Owner)
+{
+   pkgAcquireStatus::Pulse(Owner);
+   if (Recorder != 0)
+      Recorder->Pulse(*this, Owner);
+
+   struct timespec Now;
+   clock_gettime(CLOCK_MONOTONIC, &Now);
+   double Time = Now.tv_sec + Now.tv_nsec / 1e9;
+   if (LastPulse >= 0 && Time - LastPulse < Interval)
+      return true;
+   LastPulse = Time;
+
+   PyCbObj_END_ALLOW_THREADS
+   bool res = true;
+   if (pyAcquire == NULL)
+      pyAcquire = PyAcquire_FromCpp(Owner, false, NULL);
+   Py_INCREF(pyAcquire);
+   PyObject *result = NULL;
+   if (RunSimpleCallback("pulse", TUPLEIZE(pyAcquire), &result)) {
+      // only an explicit false cancels
+      if (result != NULL && result != Py_None)
+         res = PyObject_IsTrue(result) != 0;
+      Py_XDECREF(result);
+   }
+   PyCbObj_BEGIN_ALLOW_THREADS
+   return res;
+}
+
+// event queue interface
+
+const char *PyFetchEvents::TypeNames[] = {
+   "start", "fetch", "done", "fail", "ims_hit", "pulse", "stop", "media_change"
+};
+
+PyFetchEvents::PyFetchEvents(bool Queueing) : pkgAcquireStatus(),
+   Queueing(Queueing), Fd(-1), Recorder(0)
+{
+   if (Queueing)
+      Fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+}
+
+PyFetchEvents::~PyFetchEvents()
+{
+   if (Fd != -1)
+      close(Fd);
+}
+
+void PyFetchEvents::Push(Event &&E)
+{
+   if (Queueing == false)
+      return;
+   std::lock_guard<std::mutex> Guard(Lock);
+   // Pulses only describe the current state, keep the latest one
+   if (E.Type == EvPulse && Queue.empty() == false && Queue.back().Type == EvPulse) {
+      Queue.back() = std::move(E);
+      return;
+   }
+   Queue.push_back(std::move(E));
+   if (Fd != -1) {
+      // Can only fail on counter overflow, the fd is readable then anyway
+      uint64_t One = 1;
+      ssize_t Res = write(Fd, &One, sizeof(One));
+      (void)Res;
+   }
+}
+
+void PyFetchEvents::PushItem(int Type, pkgAcquire::ItemDesc &Itm)
+{
+   if (Queueing == false)
+      return;
+
+   Event E;
+   E.Type = Type;
+   E.URI = Itm.URI;
+   E.Description = Itm.Description;
+   E.ShortDesc = Itm.ShortDesc;
+   E.Current = Itm.Owner->PartialSize;
+   E.Total = Itm.Owner->FileSize;
+   if (Type == EvFail)
+      E.Message = Itm.Owner->ErrorText;
+   Push(std::move(E));
+}
+
+std::deque<PyFetchEvents::Event> PyFetchEvents::Take()
+{
+   std::deque<Event> Res;
+   std::lock_guard<std::mutex> Guard(Lock);
+   if (Fd != -1) {
+      // Reset the counter; fails with EAGAIN if nothing was pending
+      uint64_t Count;
+      ssize_t Res = read(Fd, &Count, sizeof(Count));
+      (void)Res;
+   }
+   Res.swap(Queue);
+   return Res;
+}
+
+bool PyFetchEvents::MediaChange(std::string Media, std::string Drive)
+{
+   // Nobody can answer from here, report it and give up on the medium
+   Event E{EvMediaChange, "", Drive, "", 0, 0, Media};
+   Push(std::move(E));
+   return false;
+}
+
+void PyFetchEvents::IMSHit(pkgAcquire::ItemDesc &Itm)
+{
+   if (Recorder != 0)
+      Recorder->Hit(Itm);
+   PushItem(EvHit, Itm);
+}
+
+void PyFetchEvents::Fetch(pkgAcquire::ItemDesc &Itm)
+{
+   if (Recorder != 0)
+      Recorder->Fetch(Itm);
+   PushItem(EvFetch, Itm);
+}
+
+void PyFetchEvents::Done(pkgAcquire::ItemDesc &Itm)
+{
+   if (Recorder != 0)
+      Recorder->Done(Itm);
+   PushItem(EvDone, Itm);
+}
+
+void PyFetchEvents::Fail(pkgAcquire::ItemDesc &Itm)
+{
+   if (Recorder != 0)
+      Recorder->Fail(Itm);
+   // Same filtering of transient failures as PyFetchProgress
+   if (Itm.Owner->Status == pkgAcquire::Item::StatIdle)
+      return;
+   PushItem(EvFail, Itm);
+}
+
+void PyFetchEvents::Start()
+{
+   pkgAcquireStatus::Start();
+   if (Recorder != 0)
+      Recorder->Start();
+   Push(Event{EvStart, "", "", "", 0, 0, ""});
+}
+
+void PyFetchEvents::Stop()
+{
+   pkgAcquireStatus::Stop();
+   if (Recorder != 0)
+      Recorder->Stop(*this);
+   Push(Event{EvStop, "", "", "", FetchedBytes, TotalBytes, ""});
+}
+
+bool PyFetchEvents::Pulse(pkgAcquire *Owner)
+{
+   pkgAcquireStatus::Pulse(Owner);
+   if (Recorder != 0)
+      Recorder->Pulse(*this, Owner);
+   Push(Event{EvPulse, "", "", "", CurrentBytes, TotalBytes, ""});
+   return true;
+}
+
+
 // install progress
 
 void PyInstallProgress::StartUpdate()
@@ -326,6 +685,166 @@ void PyInstallProgress::FinishUpdate()
    RunSimpleCallback("finish_update");
 }
 
+bool PyWaitChild(pid_t Pid, int Fd, double Timeout,
+                 std::function<bool()> const &Update, int &Status)
+{
+   int PidFd = -1;
+#ifdef SYS_pidfd_open
+   PidFd = syscall(SYS_pidfd_open, Pid, 0);
+#endif
+   int EpollFd = epoll_create1(EPOLL_CLOEXEC);
+   if (EpollFd < 0) {
+      PyErr_SetFromErrno(PyExc_OSError);
+      if (PidFd >= 0)
+	 close(PidFd);
+      return false;
+   }
+
+   struct epoll_event Event = {};
+   Event.events = EPOLLIN;
+   if (PidFd >= 0) {
+      Event.data.fd = PidFd;
+      epoll_ctl(EpollFd, EPOLL_CTL_ADD, PidFd, &Event);
+   }
+   if (Fd >= 0) {
+      Event.data.fd = Fd;
+      if (epoll_ctl(EpollFd, EPOLL_CTL_ADD, Fd, &Event) != 0)
+	 Fd = -1;
+   }
+
+   int TimeoutMs = (Timeout < 0) ? -1 : (int)(Timeout * 1000);
+   // Without a pidfd (before Linux 5.3), the exit can only be polled for
+   if (PidFd < 0 && (TimeoutMs < 0 || TimeoutMs > 100))
+      TimeoutMs = 100;
+
+   bool Res = true;
+   while (true) {
+      struct epoll_event Events[2];
+      int Count;
+      Py_BEGIN_ALLOW_THREADS
+      Count = epoll_wait(EpollFd, Events, 2, TimeoutMs);
+      Py_END_ALLOW_THREADS
+      if (Count < 0) {
+	 if (errno == EINTR && PyErr_CheckSignals() == 0)
+	    continue;
+	 if (errno != EINTR)
+	    PyErr_SetFromErrno(PyExc_OSError);
+	 Res = false;
+	 break;
+      }
+
+      bool Output = (Count == 0 && Timeout >= 0);
+      bool Exited = false;
+      for (int I = 0; I < Count; I++) {
+	 int Pending = 0;
+	 if (Events[I].data.fd == PidFd)
+	    Exited = true;
+	 else if ((Events[I].events & EPOLLHUP) &&
+		  (ioctl(Fd, FIONREAD, &Pending) != 0 || Pending == 0)) {
+	    // All writers are gone and everything has been read
+	    epoll_ctl(EpollFd, EPOLL_CTL_DEL, Fd, 0);
+	    Fd = -1;
+	 } else
+	    Output = true;
+      }
+
+      if (Output && Update() == false) {
+	 Res = false;
+	 break;
+      }
+      if (Exited || PidFd < 0) {
+	 pid_t Waited = waitpid(Pid, &Status, Exited ? 0 : WNOHANG);
+	 if (Waited == Pid)
+	    break;
+	 if (Waited < 0 && errno == ECHILD) {
+	    Status = 0;
+	    break;
+	 }
+	 if (Waited < 0 && errno != EINTR) {
+	    PyErr_SetFromErrno(PyExc_OSError);
+	    Res = false;
+	    break;
+	 }
+      }
+   }
+
+   // Handle the output written right before the child exited
+   int Available, Last = -1;
+   while (Res && Fd >= 0 && ioctl(Fd, FIONREAD, &Available) == 0 &&
+	  Available > 0 && Available != Last) {
+      Last = Available;
+      Res = Update();
+   }
+
+   close(EpollFd);
+   if (PidFd >= 0)
+      close(PidFd);
+   return Res;
+}
+
+char *doc_WaitChild =
+   "wait_child(pid: int[, fd: int = -1, callback = None, timeout: float = -1])"
+   " -> int\n\n"
+   "Wait for the child process 'pid' to exit and return its status, as\n"
+   "in os.waitpid(). The callable 'callback' is called whenever the file\n"
+   "descriptor 'fd' is readable and, if 'timeout' is not negative, after\n"
+   "'timeout' seconds without anything to read. The GIL is released while\n"
+   "waiting, which uses a pidfd and epoll instead of polling.";
+PyObject *WaitChild(PyObject *Self,PyObject *Args,PyObject *kwds)
+{
+   int Pid;
+   int Fd = -1;
+   PyObject *Callback = Py_None;
+   double Timeout = -1;
+   char *kwlist[] = {"pid", "fd", "callback", "timeout", 0};
+   if (PyArg_ParseTupleAndKeywords(Args, kwds, "i|iOd", kwlist, &Pid, &Fd,
+				   &Callback, &Timeout) == 0)
+      return 0;
+   if (Callback != Py_None && !PyCallable_Check(Callback)) {
+      PyErr_SetString(PyExc_TypeError, "'callback' must be callable or None");
+      return 0;
+   }
+
+   int Status = 0;
+   bool Res = PyWaitChild(Pid, Fd, Timeout, [Callback]() {
+      if (Callback == Py_None)
+	 return true;
+      PyObject *Result = PyObject_CallObject(Callback, NULL);
+      Py_XDECREF(Result);
+      return Result != NULL;
+   }, Status);
+   if (Res == false)
+      return 0;
+   return MkPyNumber(Status);
+}
+
+// Whether update_interface() differs from the one of
+// apt.progress.base.InstallProgress, which does nothing without output.
+static bool OverridesUpdateInterface(PyObject *Inst)
+{
+   PyObject *Own = PyObject_GetAttrString((PyObject *)Py_TYPE(Inst),
+					  "update_interface");
+   if (Own == NULL) {
+      PyErr_Clear();
+      return false;
+   }
+   bool Res = true;
+   PyObject *Module = PyImport_ImportModule("apt.progress.base");
+   PyObject *Base = NULL, *Inherited = NULL;
+   if (Module != NULL)
+      Base = PyObject_GetAttrString(Module, "InstallProgress");
+   if (Base != NULL)
+      Inherited = PyObject_GetAttrString(Base, "update_interface");
+   if (Inherited != NULL)
+      Res = PyObject_RichCompareBool(Own, Inherited, Py_EQ) != 1;
+   PyErr_Clear();
+   Py_XDECREF(Inherited);
+   Py_XDECREF(Base);
+   Py_XDECREF(Module);
+   Py_DECREF(Own);
+   return Res;
+}
+
 pkgPackageManager::OrderResult PyInstallProgress::Run(pkgPackageManager *pm)
 {
    pkgPackageManager::OrderResult res;
@@ -413,13 +932,41 @@ pkgPackageManager::OrderResult PyInstallProgress::Run(pkgPackageManager *pm)
       PyCbObj_BEGIN_ALLOW_THREADS
       //std::cerr << "got child_res: " << res << std::endl;
    } else {
-      //std::cerr << "using build-in waitpid()" << std::endl;
-      PyCbObj_BEGIN_ALLOW_THREADS
-      while (waitpid(child_id, &ret, WNOHANG) == 0) {
-	 PyCbObj_END_ALLOW_THREADS
-	 UpdateInterface();
-         PyCbObj_BEGIN_ALLOW_THREADS
+      // Wake up on status output and on the exit of the child only
+      int fd = -1;
+      PyObject *v = PyObject_GetAttrString(callbackInst, "statusfd");
+      if (v != NULL) {
+	 fd = PyObject_AsFileDescriptor(v);
+	 Py_DECREF(v);
+      }
+      if (fd < 0)
+	 PyErr_Clear();
+      // Like wait_child(), only wake up without output to keep an
+      // overridden update_interface() alive
+      double timeout = -1;
+      v = NULL;
+      if (OverridesUpdateInterface(callbackInst))
+	 v = PyObject_GetAttrString(callbackInst, "select_timeout");
+      if (v != NULL) {
+	 timeout = PyFloat_AsDouble(v);
+	 Py_DECREF(v);
+      }
+      if (PyErr_Occurred()) {
+	 PyErr_Clear();
+	 timeout = -1;
       }
+      if (!PyWaitChild(child_id, fd, timeout, [this]() {
+	    RunSimpleCallback("update_interface");
+	    return true;
+	 }, ret)) {
+	 PyErr_Print();
+	 PyCbObj_BEGIN_ALLOW_THREADS
+	 // Do not leave the child behind as a zombie
+	 while (waitpid(child_id, &ret, 0) < 0 && errno == EINTR)
+	    ;
+	 return pkgPackageManager::Failed;
+      }
+      PyCbObj_BEGIN_ALLOW_THREADS
 
       res = (pkgPackageManager::OrderResult) WEXITSTATUS(ret);
       //std::cerr << "build-in waitpid() got: " << res << std::endl;
@@ -14,6 +14,12 @@
 #include <apt-pkg/packagemanager.h>
 #include <apt-pkg/cdrom.h>
 #include <Python.h>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
 
 /* PyCbObj_BEGIN_ALLOW_THREADS and PyCbObj_END_ALLOW_THREADS are sligthly
  * modified versions of Py_BEGIN_ALLOW_THREADS and Py_END_ALLOW_THREADS.
@@ -60,6 +66,71 @@ struct PyOpProgress : public OpProgress, public PyCallbackObj
 };
 
 
+/* Fetch statistics, readable from Python through Acquire.stats. They are
+ * written by the fetch status objects without holding the GIL. */
+struct PyFetchStats
+{
+   enum {
+      CurrentBytes, TotalBytes, FetchedBytes, CurrentCPS, ElapsedTime,
+      CurrentItems, TotalItems, DoneItems, FailedItems, HitItems,
+      CacheHits, CacheMisses, Count
+   };
+   static const char *Names[];
+
+   unsigned long long Values[Count];
+
+   void Update(pkgAcquireStatus const &Status);
+};
+
+/* Timing and size of a single item, for Acquire.item_stats(). Times are
+ * seconds since the epoch, or -1 if not observed. */
+struct PyFetchItemRecord
+{
+   enum { Pending, Done, Failed, Hit };
+
+   std::string URI;
+   std::string ShortDesc;
+   int Status;
+   double Queued;
+   double Started;
+   double FirstByte;
+   double Finished;
+   unsigned long long Bytes;
+   unsigned int Fetches;
+};
+
+/* Collects the statistics of a fetcher. Called by the fetch status
+ * objects from the thread running the fetcher, which might not hold the
+ * GIL. Stats is not owned; the item records are protected by Lock.
+ */
+class PyFetchRecorder
+{
+   std::unordered_map<pkgAcquire::Item *, size_t> Index;
+   double RunStart;
+   bool Pulsed;
+
+   PyFetchItemRecord &Record(pkgAcquire::Item *Owner, double Now);
+
+   public:
+   PyFetchStats *Stats;
+   std::mutex Lock;
+   std::vector<PyFetchItemRecord> Items;
+
+   void Start();
+   void Fetch(pkgAcquire::ItemDesc &Itm);
+   void Hit(pkgAcquire::ItemDesc &Itm);
+   void Done(pkgAcquire::ItemDesc &Itm);
+   void Fail(pkgAcquire::ItemDesc &Itm);
+   void Pulse(pkgAcquireStatus const &Status, pkgAcquire *Owner);
+   void Stop(pkgAcquireStatus const &Status);
+   // Called before items are deleted, as a new item may reuse the address
+   void Forget(pkgAcquire::Item *Owner);
+   void ForgetAll();
+
+   PyFetchRecorder(PyFetchStats *Stats) : RunStart(-1), Pulsed(false),
+      Stats(Stats) {};
+};
+
 struct PyFetchProgress : public pkgAcquireStatus, public PyCallbackObj
 {
    protected:
@@ -89,10 +160,90 @@ struct PyFetchProgress : public pkgAcquireStatus, public PyCallbackObj
    virtual void Stop();
 
    bool Pulse(pkgAcquire * Owner);
-   PyFetchProgress() : PyCallbackObj(), pyAcquire(0) {};
+
+   PyFetchRecorder *Recorder;
+
+   PyFetchProgress() : PyCallbackObj(), pyAcquire(0), Recorder(0) {};
    ~PyFetchProgress()  { Py_XDECREF(pyAcquire); };
 };
 
+/* Progress which only calls start(), stop(), media_change() and, at most
+ * once per Interval seconds, pulse(). Item events are only passed to the
+ * Recorder, so no wrapper objects are created for them.
+ */
+struct PyFetchStructProgress : public PyFetchProgress
+{
+   double Interval;
+   double LastPulse;
+
+   virtual void IMSHit(pkgAcquire::ItemDesc &Itm);
+   virtual void Fetch(pkgAcquire::ItemDesc &Itm);
+   virtual void Done(pkgAcquire::ItemDesc &Itm);
+   virtual void Fail(pkgAcquire::ItemDesc &Itm);
+   virtual bool Pulse(pkgAcquire *Owner);
+
+   PyFetchStructProgress(double Interval) : PyFetchProgress(),
+      Interval(Interval), LastPulse(-1) {};
+};
+
+/* Fetch status which does not call into Python. If Queueing is set,
+ * events are queued from the thread running the fetcher, which does not
+ * hold the GIL, and are drained by Acquire.poll_events(). Fd is an
+ * eventfd which is readable while events are pending. Otherwise, events
+ * are only passed to the Recorder.
+ */
+struct PyFetchEvents : public pkgAcquireStatus
+{
+   enum {
+      EvStart, EvFetch, EvDone, EvFail, EvHit, EvPulse, EvStop, EvMediaChange
+   };
+   static const char *TypeNames[];
+
+   struct Event {
+      int Type;
+      std::string URI;
+      std::string Description;
+      std::string ShortDesc;
+      unsigned long long Current;
+      unsigned long long Total;
+      std::string Message;
+   };
+
+   bool Queueing;
+   int Fd;
+   PyFetchRecorder *Recorder;
+
+   std::deque<Event> Take();
+
+   /* apt stuff */
+   virtual bool MediaChange(std::string Media, std::string Drive);
+   virtual void IMSHit(pkgAcquire::ItemDesc &Itm);
+   virtual void Fetch(pkgAcquire::ItemDesc &Itm);
+   virtual void Done(pkgAcquire::ItemDesc &Itm);
+   virtual void Fail(pkgAcquire::ItemDesc &Itm);
+   virtual void Start();
+   virtual void Stop();
+   virtual bool Pulse(pkgAcquire *Owner);
+
+   PyFetchEvents(bool Queueing);
+   virtual ~PyFetchEvents();
+
+   protected:
+   std::mutex Lock;
+   std::deque<Event> Queue;
+
+   void Push(Event &&E);
+   void PushItem(int Type, pkgAcquire::ItemDesc &Itm);
+};
+
+/* Wait for the child Pid to exit, calling Update when Fd has data, or
+ * after Timeout seconds without any if Timeout is not negative. The GIL
+ * must be held; it is released while waiting. Status is set as by
+ * waitpid(). Returns false with a Python exception set if Update returns
+ * false or waiting fails. */
+bool PyWaitChild(pid_t Pid, int Fd, double Timeout,
+                 std::function<bool()> const &Update, int &Status);
+
 struct PyInstallProgress : public PyCallbackObj
 {
    void StartUpdate();
@@ -75,8 +75,13 @@ static PyObject *PkgSourceListGetIndexes(PyObject *Self,PyObject *Args)
    char all = 0;
    if (PyArg_ParseTuple(Args, "O!|b",&PyAcquire_Type,&pyFetcher, &all) == 0)
       return 0;
+   if (PyAcquire_CheckIdle(pyFetcher) == false)
+      return 0;
 
    pkgAcquire *fetcher = GetCpp<pkgAcquire*>(pyFetcher);
+   PyAcquireConfigScope scope(pyFetcher);
+   if (scope.Failed())
+      return 0;
    bool res = list->GetIndexes(fetcher, all);
 
    return HandleErrors(PyBool_FromLong(res));
@@ -24,6 +24,25 @@
 #include <apt-pkg/extracttar.h>
 #include <apt-pkg/error.h>
 #include <apt-pkg/dirstream.h>
+#include <apt-pkg/aptconfiguration.h>
+#include <apt-pkg/fileutl.h>
+
+#include <fcntl.h>
+#include <limits.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <condition_variable>
+#include <exception>
+#include <map>
+#include <mutex>
+#include <set>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <utility>
+#include <vector>
 
 /**
  * A subclass of pkgDirStream which calls a Python callback.
@@ -50,6 +69,8 @@ public:
     char *copy;
     // The size of the copy
     size_t copy_size;
+    // Whether to read the data of the members, or pass None instead.
+    bool with_data;
 
     virtual bool DoItem(Item &Itm,int &Fd);
     virtual bool FinishedFile(Item &Itm,int Fd);
@@ -61,7 +82,8 @@ public:
                          unsigned long Size,unsigned long Pos);
 #endif
     PyDirStream(PyObject *callback, const char *member=0) : callback(callback),
-        py_data(0), member(member), error(false), copy(0), copy_size(0)
+        py_data(0), member(member), error(false), copy(0), copy_size(0),
+        with_data(true)
     {
         Py_XINCREF(callback);
     }
@@ -73,8 +95,658 @@ public:
     }
 };
 
+/**
+ * A pkgDirStream which hands the data of a single member to a reader.
+ *
+ * ExtractTar::Go() runs in a separate thread, and the thread and the reader
+ * take turns: The thread runs until it found the member or has a chunk of
+ * its data, and then waits until the reader consumed that chunk and asks
+ * for more. The archive is thus only read while open_member() or one of the
+ * read methods is running, at most one chunk is held at a time, and the
+ * data is copied straight from the buffer of ExtractTar into the buffer of
+ * the caller.
+ */
+class TarMemberReader : public pkgDirStream
+{
+
+public:
+    ExtractTar *Tar;
+    std::string Name;
+    std::mutex Lock;
+    std::condition_variable Cond;
+    std::thread Worker;
+    // Set while the thread may run, and once the reader was closed.
+    bool WorkerTurn;
+    bool Cancelled;
+    bool Closed;
+    // Whether the member was found, and whether Go() returned.
+    bool Found;
+    bool Finished;
+    // The size of the member and the position of the reader in it.
+    unsigned long long Size;
+    unsigned long long Pos;
+    // The part of the current chunk not yet consumed by the reader.
+    const unsigned char *Data;
+    unsigned long long DataSize;
+    // Messages left in _error by the thread, as (is error, message).
+    std::vector<std::pair<bool, std::string> > Errors;
+
+    virtual bool DoItem(Item &Itm,int &Fd);
+    virtual bool FinishedFile(Item &Itm,int Fd) { return Found == false; }
+#if (APT_PKG_MAJOR >= 5)
+    virtual bool Process(Item &Itm,const unsigned char *Data,
+                         unsigned long long Size,unsigned long long Pos);
+#else
+    virtual bool Process(Item &Itm,const unsigned char *Data,
+                         unsigned long Size,unsigned long Pos);
+#endif
+
+    void Run();
+    bool Yield();
+    void Wait();
+    size_t ReadInto(char *Buffer, size_t Length);
+    void Close();
+
+    TarMemberReader(ExtractTar *Tar, const char *Name) : Tar(Tar),
+        Name(Name), WorkerTurn(true), Cancelled(false), Closed(false),
+        Found(false), Finished(false), Size(0), Pos(0), Data(0), DataSize(0)
+    {
+    }
+    virtual ~TarMemberReader() { Close(); }
+};
+
+/**
+ * A pkgDirStream which reads several members into a dict in one pass.
+ *
+ * The data is read directly into the bytes objects put into the dict. Go()
+ * is stopped once all requested members have been read.
+ */
+class PyMemberDictStream : public pkgDirStream
+{
+
+public:
+    PyObject *dict;
+    // The requested members not read yet, or NULL for all regular files.
+    std::set<std::string> *wanted;
+    // The data of the current member.
+    PyObject *py_data;
+    // Set when Go() was stopped because all members were read.
+    bool complete;
+
+    virtual bool DoItem(Item &Itm,int &Fd);
+    virtual bool FinishedFile(Item &Itm,int Fd);
+#if (APT_PKG_MAJOR >= 5)
+    virtual bool Process(Item &Itm,const unsigned char *Data,
+                         unsigned long long Size,unsigned long long Pos);
+#else
+    virtual bool Process(Item &Itm,const unsigned char *Data,
+                         unsigned long Size,unsigned long Pos);
+#endif
+
+    PyMemberDictStream(std::set<std::string> *wanted) : dict(PyDict_New()),
+        wanted(wanted), py_data(0), complete(false) {}
+    virtual ~PyMemberDictStream() { Py_XDECREF(dict); Py_XDECREF(py_data); }
+};
+
+/**
+ * A pkgDirStream which collects the members, or just their names, into
+ * a list. The data is skipped by ExtractTar without being copied.
+ */
+class PyMemberListStream : public pkgDirStream
+{
+
+public:
+    PyObject *list;
+    // Collect the names instead of TarMember objects.
+    bool names;
+
+    virtual bool DoItem(Item &Itm,int &Fd) { Fd = -1; return true; }
+    virtual bool FinishedFile(Item &Itm,int Fd);
+
+    PyMemberListStream(bool names) : list(PyList_New(0)), names(names) {}
+    virtual ~PyMemberListStream() { Py_XDECREF(list); }
+};
+
+/**
+ * A pkgDirStream which feeds the data of the regular files into apt's
+ * Hashes, without copying it into Python objects.
+ */
+class PyHashStream : public pkgDirStream
+{
+    unsigned int Types;
+    // The hashes of the current member.
+    Hashes *Current;
+
+public:
+    std::map<std::string, HashStringList> &Results;
+
+    virtual bool DoItem(Item &Itm,int &Fd);
+    virtual bool FinishedFile(Item &Itm,int Fd);
+#if (APT_PKG_MAJOR >= 5)
+    virtual bool Process(Item &Itm,const unsigned char *Data,
+                         unsigned long long Size,unsigned long long Pos);
+#else
+    virtual bool Process(Item &Itm,const unsigned char *Data,
+                         unsigned long Size,unsigned long Pos);
+#endif
+
+    PyHashStream(unsigned int Types,
+                 std::map<std::string, HashStringList> &Results) :
+        Types(Types), Current(0), Results(Results) {}
+    virtual ~PyHashStream() { delete Current; }
+};
+
+/**
+ * A pkgDirStream which extracts the archive below a directory.
+ *
+ * Unlike the default pkgDirStream, this creates the members relative to a
+ * directory file descriptor instead of the current directory, preallocates
+ * regular files and collects their data in a large buffer, so that there
+ * is one write() per megabyte instead of one per block of the archive.
+ */
+class PyExtractStream : public pkgDirStream
+{
+    int DirFd;
+    // The file currently written, and its pending data.
+    int Current;
+    char *Buffer;
+    size_t Used;
+    // The directory of the last member, which is usually the next one's.
+    std::string ParentName;
+    int ParentFd;
+
+    bool Flush(Item &Itm);
+    int OpenParent(std::string const &Dir);
+
+public:
+    static const size_t BufferSize = 1 << 20;
+
+    virtual bool DoItem(Item &Itm,int &Fd);
+    virtual bool FinishedFile(Item &Itm,int Fd);
+    virtual bool Fail(Item &Itm,int Fd);
+#if (APT_PKG_MAJOR >= 5)
+    virtual bool Process(Item &Itm,const unsigned char *Data,
+                         unsigned long long Size,unsigned long long Pos);
+#else
+    virtual bool Process(Item &Itm,const unsigned char *Data,
+                         unsigned long Size,unsigned long Pos);
+#endif
+
+    PyExtractStream(int DirFd) : DirFd(DirFd), Current(-1), Buffer(0), Used(0),
+                                 ParentFd(-1)
+    {
+        void *Mem;
+        if (posix_memalign(&Mem, 4096, BufferSize) == 0)
+            Buffer = (char *) Mem;
+    }
+    virtual ~PyExtractStream()
+    {
+        if (Current != -1)
+            close(Current);
+        if (ParentFd != -1 && ParentFd != DirFd)
+            close(ParentFd);
+        free(Buffer);
+    }
+};
+
+// Create a TarMember object holding a copy of the Item.
+static PyObject *tarmember_from_item(pkgDirStream::Item &Itm)
+{
+    CppPyObject<pkgDirStream::Item> *py_member;
+    py_member = CppPyObject_NEW<pkgDirStream::Item>(0, &PyTarMember_Type);
+    // Clone our object, including the strings in it.
+    py_member->Object = Itm;
+    py_member->Object.Name = new char[strlen(Itm.Name)+1];
+    py_member->Object.LinkTarget = new char[strlen(Itm.LinkTarget)+1];
+    strcpy(py_member->Object.Name, Itm.Name);
+    strcpy(py_member->Object.LinkTarget,Itm.LinkTarget);
+    py_member->NoDelete = true;
+    return py_member;
+}
+
+bool PyMemberListStream::FinishedFile(Item &Itm,int Fd)
+{
+    if (list == NULL)
+        return false;
+    PyObject *obj = names ? CppPyPath(Itm.Name) : tarmember_from_item(Itm);
+    if (obj == NULL || PyList_Append(list, obj) == -1) {
+        Py_XDECREF(obj);
+        Py_CLEAR(list);
+        return false;
+    }
+    Py_DECREF(obj);
+    return true;
+}
+
+bool PyMemberDictStream::DoItem(Item &Itm,int &Fd)
+{
+    Fd = -1;
+    if (wanted ? wanted->count(Itm.Name) == 0 : Itm.Type != Item::File)
+        return true;
+    if (Itm.Size > PY_SSIZE_T_MAX) {
+        PyErr_Format(PyExc_MemoryError,
+                     "The member %s was too large to read into memory",
+                     Itm.Name);
+        return false;
+    }
+    Py_XDECREF(py_data);
+    py_data = PyBytes_FromStringAndSize(NULL, Itm.Size);
+    if (py_data == NULL)
+        return false;
+    Fd = -2;
+    return true;
+}
+
+#if (APT_PKG_MAJOR >= 5)
+bool PyMemberDictStream::Process(Item &Itm,const unsigned char *Data,
+                                 unsigned long long Size,unsigned long long Pos)
+#else
+bool PyMemberDictStream::Process(Item &Itm,const unsigned char *Data,
+                                 unsigned long Size,unsigned long Pos)
+#endif
+{
+    memcpy(PyBytes_AS_STRING(py_data) + Pos, Data, Size);
+    return true;
+}
+
+bool PyMemberDictStream::FinishedFile(Item &Itm,int Fd)
+{
+    if (py_data == NULL)
+        return true;
+    PyObject *name = CppPyPath(Itm.Name);
+    int res = name ? PyDict_SetItem(dict, name, py_data) : -1;
+    Py_XDECREF(name);
+    Py_CLEAR(py_data);
+    if (res == -1)
+        return false;
+    if (wanted != NULL) {
+        wanted->erase(Itm.Name);
+        complete = wanted->empty();
+    }
+    return complete == false;
+}
+
+bool PyHashStream::DoItem(Item &Itm,int &Fd)
+{
+    Fd = -1;
+    if (Itm.Type != Item::File)
+        return true;
+    delete Current;
+    Current = new Hashes(Types);
+    Fd = -2;
+    return true;
+}
+
+#if (APT_PKG_MAJOR >= 5)
+bool PyHashStream::Process(Item &Itm,const unsigned char *Data,
+                           unsigned long long Size,unsigned long long Pos)
+#else
+bool PyHashStream::Process(Item &Itm,const unsigned char *Data,
+                           unsigned long Size,unsigned long Pos)
+#endif
+{
+    return Current->Add(Data, Size);
+}
+
+bool PyHashStream::FinishedFile(Item &Itm,int Fd)
+{
+    // Tar stores the data of a hard linked file once, with its first
+    // name; the other names have the hashes of the file they link to.
+    if (Itm.Type == Item::HardLink && Itm.LinkTarget != NULL) {
+        const char *Target = Itm.LinkTarget;
+        if (strncmp(Target, "./", 2) == 0 && Target[2] != '\0')
+            Target += 2;
+        auto Linked = Results.find(Target);
+        if (Linked != Results.end())
+            Results[Itm.Name] = Linked->second;
+        return true;
+    }
+    if (Current == NULL)
+        return true;
+    Results[Itm.Name] = Current->GetHashStringList();
+    delete Current;
+    Current = NULL;
+    return true;
+}
+
+/* Split the name of a member into its directory and its last component,
+ * dropping empty and "." components. Absolute names and names with ".."
+ * components are rejected, as they could leave the target directory. */
+static bool SplitMemberName(const char *Name, std::string &Dir,
+                            std::string &Leaf)
+{
+    if (Name[0] == '/')
+        return _error->Error("Refusing to extract the absolute path %s", Name);
+    Dir.clear();
+    Leaf.clear();
+    for (const char *Start = Name; *Start != '\0';) {
+        const char *End = strchrnul(Start, '/');
+        std::string Part(Start, End - Start);
+        Start = (*End == '/') ? End + 1 : End;
+        if (Part.empty() || Part == ".")
+            continue;
+        if (Part == "..")
+            return _error->Error("Refusing to extract %s, it is outside "
+                                 "the target directory", Name);
+        if (Leaf.empty() == false)
+            Dir += (Dir.empty() ? "" : "/") + Leaf;
+        Leaf = Part;
+    }
+    return true;
+}
+
+/* Open the directory Dir below DirFd one component at a time, without
+ * following symbolic links, so that links created by earlier members
+ * cannot redirect later ones outside of DirFd. Dir is as returned by
+ * SplitMemberName(); DirFd itself is returned for the empty string. */
+static int OpenBeneath(int DirFd, std::string const &Dir)
+{
+    int Fd = DirFd;
+    size_t Start = 0;
+    while (Start < Dir.size()) {
+        size_t End = Dir.find('/', Start);
+        if (End == std::string::npos)
+            End = Dir.size();
+        std::string const Part = Dir.substr(Start, End - Start);
+        int Next = openat(Fd, Part.c_str(),
+                          O_RDONLY|O_DIRECTORY|O_NOFOLLOW|O_CLOEXEC);
+        int Errno = errno;
+        if (Fd != DirFd)
+            close(Fd);
+        if (Next == -1) {
+            errno = Errno;
+            return -1;
+        }
+        Fd = Next;
+        Start = End + 1;
+    }
+    return Fd;
+}
+
+int PyExtractStream::OpenParent(std::string const &Dir)
+{
+    if (ParentFd != -1 && ParentName == Dir)
+        return ParentFd;
+    if (ParentFd != -1 && ParentFd != DirFd)
+        close(ParentFd);
+    ParentFd = OpenBeneath(DirFd, Dir);
+    ParentName = Dir;
+    return ParentFd;
+}
+
+// Remove what an earlier extraction left at Name, unless it is a directory.
+static bool RemoveExisting(int Parent, std::string const &Leaf, const char *Name)
+{
+    struct stat Buf;
+    if (fstatat(Parent, Leaf.c_str(), &Buf, AT_SYMLINK_NOFOLLOW) != 0)
+        return true;
+    if (S_ISDIR(Buf.st_mode))
+        return _error->Error("Failed to create %s: A directory is in the way",
+                             Name);
+    if (unlinkat(Parent, Leaf.c_str(), 0) != 0 && errno != ENOENT)
+        return _error->Errno("unlinkat", "Failed to replace %s", Name);
+    return true;
+}
+
+bool PyExtractStream::DoItem(Item &Itm,int &Fd)
+{
+    Fd = -1;
+    std::string Dir, Leaf;
+    if (SplitMemberName(Itm.Name, Dir, Leaf) == false)
+        return false;
+    // The target directory itself, usually named "./"
+    if (Leaf.empty())
+        return true;
+    int Parent = OpenParent(Dir);
+    if (Parent == -1)
+        return _error->Errno("openat", "Failed to open the directory of %s",
+                             Itm.Name);
+
+    switch (Itm.Type) {
+    case Item::File: {
+        if (Buffer == NULL)
+            return _error->Error("Could not allocate the output buffer");
+        // Create a new file, instead of writing to whatever is there
+        if (RemoveExisting(Parent, Leaf, Itm.Name) == false)
+            return false;
+        Current = openat(Parent, Leaf.c_str(),
+                         O_WRONLY|O_CREAT|O_EXCL|O_NOFOLLOW|O_CLOEXEC,
+                         Itm.Mode);
+        if (Current == -1)
+            return _error->Errno("openat", "Failed to write file %s",
+                                 Itm.Name);
+        // fchmod deals with umask and fchown sets the ownership
+        if (fchmod(Current, Itm.Mode) != 0)
+            return _error->Errno("fchmod", "Failed to write file %s",
+                                 Itm.Name);
+        if (fchown(Current, Itm.UID, Itm.GID) != 0 && errno != EPERM)
+            return _error->Errno("fchown", "Failed to write file %s",
+                                 Itm.Name);
+        // Allocate the space at once, if the file system supports it.
+        if (Itm.Size > 0 && fallocate(Current, 0, 0, Itm.Size) != 0 &&
+            errno != EOPNOTSUPP && errno != ENOSYS && errno != EINVAL)
+            return _error->Errno("fallocate", "Failed to write file %s",
+                                 Itm.Name);
+        Used = 0;
+        Fd = -2;
+        return true;
+    }
+    case Item::Directory: {
+        struct stat Buf;
+        if (fstatat(Parent, Leaf.c_str(), &Buf, AT_SYMLINK_NOFOLLOW) == 0) {
+            if (S_ISDIR(Buf.st_mode))
+                return true;
+            return _error->Error("Failed to create directory %s: "
+                                 "Something else is in the way", Itm.Name);
+        }
+        if (mkdirat(Parent, Leaf.c_str(), Itm.Mode) != 0)
+            return _error->Errno("mkdirat", "Failed to create directory %s",
+                                 Itm.Name);
+        return true;
+    }
+    case Item::SymbolicLink:
+        // The target is never followed while extracting, so it may point
+        // anywhere, like the absolute and relative links in packages do.
+        if (RemoveExisting(Parent, Leaf, Itm.Name) == false)
+            return false;
+        if (symlinkat(Itm.LinkTarget, Parent, Leaf.c_str()) != 0)
+            return _error->Errno("symlinkat", "Failed to create link %s",
+                                 Itm.Name);
+        return true;
+    case Item::HardLink: {
+        // The target must be a member extracted before, below DirFd
+        std::string TargetDir, TargetLeaf;
+        if (SplitMemberName(Itm.LinkTarget, TargetDir, TargetLeaf) == false)
+            return false;
+        if (TargetLeaf.empty())
+            return _error->Error("Failed to create link %s: Invalid target",
+                                 Itm.Name);
+        int Target = OpenBeneath(DirFd, TargetDir);
+        if (Target == -1)
+            return _error->Errno("openat", "Failed to create link %s",
+                                 Itm.Name);
+        bool Res = RemoveExisting(Parent, Leaf, Itm.Name);
+        if (Res && linkat(Target, TargetLeaf.c_str(), Parent, Leaf.c_str(), 0) != 0)
+            Res = _error->Errno("linkat", "Failed to create link %s", Itm.Name);
+        if (Target != DirFd)
+            close(Target);
+        return Res;
+    }
+    default:
+        // Device files and FIFOs are not created, like in pkgDirStream.
+        return true;
+    }
+}
+
+// Write out the buffered data of the current file.
+bool PyExtractStream::Flush(Item &Itm)
+{
+    size_t Done = 0;
+    while (Done < Used) {
+        ssize_t Res = write(Current, Buffer + Done, Used - Done);
+        if (Res < 0 && errno == EINTR)
+            continue;
+        if (Res < 0)
+            return _error->Errno("write", "Failed to write file %s",
+                                 Itm.Name);
+        Done += Res;
+    }
+    Used = 0;
+    return true;
+}
+
+#if (APT_PKG_MAJOR >= 5)
+bool PyExtractStream::Process(Item &Itm,const unsigned char *Data,
+                              unsigned long long Size,unsigned long long Pos)
+#else
+bool PyExtractStream::Process(Item &Itm,const unsigned char *Data,
+                              unsigned long Size,unsigned long Pos)
+#endif
+{
+    while (Size > 0) {
+        size_t Count = std::min<unsigned long long>(Size, BufferSize - Used);
+        memcpy(Buffer + Used, Data, Count);
+        Used += Count;
+        Data += Count;
+        Size -= Count;
+        if (Used == BufferSize && Flush(Itm) == false)
+            return false;
+    }
+    return true;
+}
+
+bool PyExtractStream::FinishedFile(Item &Itm,int Fd)
+{
+    if (Current == -1)
+        return true;
+    bool Res = Flush(Itm);
+    struct timespec Times[2];
+    Times[0].tv_sec = Times[1].tv_sec = Itm.MTime;
+    Times[0].tv_nsec = Times[1].tv_nsec = 0;
+    if (Res && futimens(Current, Times) != 0)
+        Res = _error->Errno("futimens", "Failed to set modification time");
+    if (close(Current) != 0 && Res)
+        Res = _error->Errno("close", "Failed to close file %s", Itm.Name);
+    Current = -1;
+    return Res;
+}
+
+bool PyExtractStream::Fail(Item &Itm,int Fd)
+{
+    if (Current != -1)
+        close(Current);
+    Current = -1;
+    return false;
+}
+
+// Thread side: Give the turn to the reader and wait until it is ours again.
+bool TarMemberReader::Yield()
+{
+    std::unique_lock<std::mutex> Guard(Lock);
+    WorkerTurn = false;
+    Cond.notify_all();
+    Cond.wait(Guard, [this] { return WorkerTurn; });
+    return Cancelled == false;
+}
+
+bool TarMemberReader::DoItem(Item &Itm,int &Fd)
+{
+    if (Found || Name != Itm.Name) {
+        Fd = -1;
+        return true;
+    }
+    Found = true;
+    Size = Itm.Size;
+    Fd = -2;
+    return Yield();
+}
+
+#if (APT_PKG_MAJOR >= 5)
+bool TarMemberReader::Process(Item &Itm,const unsigned char *Chunk,
+                              unsigned long long ChunkSize,
+                              unsigned long long ChunkPos)
+#else
+bool TarMemberReader::Process(Item &Itm,const unsigned char *Chunk,
+                              unsigned long ChunkSize,unsigned long ChunkPos)
+#endif
+{
+    Data = Chunk;
+    DataSize = ChunkSize;
+    return Yield();
+}
+
+void TarMemberReader::Run()
+{
+    Tar->Go(*this);
+    std::lock_guard<std::mutex> Guard(Lock);
+    // _error is per thread, so keep the messages for the reader.
+    while (Cancelled == false && _error->empty() == false) {
+        std::string Msg;
+        bool Type = _error->PopMessage(Msg);
+        Errors.push_back(std::make_pair(Type, Msg));
+    }
+    _error->Discard();
+    Data = 0;
+    DataSize = 0;
+    Finished = true;
+    WorkerTurn = false;
+    Cond.notify_all();
+}
+
+// Reader side: Wait until the thread gave the turn to us.
+void TarMemberReader::Wait()
+{
+    std::unique_lock<std::mutex> Guard(Lock);
+    Cond.wait(Guard, [this] { return WorkerTurn == false; });
+}
+
+// Copy up to Length bytes into Buffer. Called without holding the GIL.
+size_t TarMemberReader::ReadInto(char *Buffer, size_t Length)
+{
+    size_t Read = 0;
+    while (Read < Length && Pos < Size) {
+        if (DataSize == 0) {
+            if (Finished)
+                break;
+            {
+                std::lock_guard<std::mutex> Guard(Lock);
+                WorkerTurn = true;
+            }
+            Cond.notify_all();
+            Wait();
+            continue;
+        }
+        size_t Count = std::min<unsigned long long>(Length - Read, DataSize);
+        memcpy(Buffer + Read, Data, Count);
+        Data += Count;
+        DataSize -= Count;
+        Read += Count;
+        Pos += Count;
+    }
+    return Read;
+}
+
+// Stop the thread. Called without holding the GIL.
+void TarMemberReader::Close()
+{
+    Closed = true;
+    if (Worker.joinable() == false)
+        return;
+    {
+        std::lock_guard<std::mutex> Guard(Lock);
+        Cancelled = true;
+        WorkerTurn = true;
+    }
+    Cond.notify_all();
+    Worker.join();
+}
+
 bool PyDirStream::DoItem(Item &Itm, int &Fd)
 {
+    if (!with_data) {
+        Fd = -1;
+        return true;
+    }
     if (!member || strcmp(Itm.Name, member) == 0) {
         // Allocate a new buffer if the old one is too small.
         if (Itm.Size > SIZE_MAX)
@@ -137,15 +809,7 @@ bool PyDirStream::FinishedFile(Item &Itm,int Fd)
         return true;
 
     // The current member and data.
-    CppPyObject<Item> *py_member;
-    py_member = CppPyObject_NEW<Item>(0, &PyTarMember_Type);
-    // Clone our object, including the strings in it.
-    py_member->Object = Itm;
-    py_member->Object.Name = new char[strlen(Itm.Name)+1];
-    py_member->Object.LinkTarget = new char[strlen(Itm.LinkTarget)+1];
-    strcpy(py_member->Object.Name, Itm.Name);
-    strcpy(py_member->Object.LinkTarget,Itm.LinkTarget);
-    py_member->NoDelete = true;
+    PyObject *py_member = tarmember_from_item(Itm);
     error = PyObject_CallFunctionObjArgs(callback, py_member, py_data, 0) == 0;
     // Clear the old objects and create new ones.
     Py_XDECREF(py_member);
@@ -338,6 +1002,209 @@ PyTypeObject PyTarMember_Type = {
 
 
 
+/**
+ * An index of the members of a tar archive, mapping their names to the
+ * offset and size of their data in the uncompressed archive.
+ *
+ * The index is built by walking the tar headers once, skipping the data.
+ * Afterwards, members of uncompressed archives are read directly from the
+ * file. For compressed archives, FileFd can only seek by decompressing, so
+ * the decompressor is kept open on a file description of its own: reading
+ * members in the order of the archive continues where the previous read
+ * stopped, and only reading backwards starts over at the beginning.
+ */
+class PyTarIndex
+{
+public:
+    struct Entry {
+        unsigned long long Offset;
+        unsigned long long Size;
+    };
+
+    std::string Compressor;
+    unsigned long long Max;
+    bool Built;
+    std::map<std::string, Entry> Members;
+
+    // The decompressing reader, whether it has its own file offset, and
+    // the value of In.Tell() at the start of the archive.
+    FileFd In;
+    bool Private;
+    unsigned long long Base;
+
+    unsigned long long Pos() { return In.Tell() - Base; }
+
+    bool Open(int Fd, unsigned long long Min);
+    bool Build(int Fd, unsigned long long Min);
+    bool Read(int Fd, unsigned long long Min, Entry const &E, char *Buffer);
+
+    PyTarIndex(const char *Compressor, unsigned long long Max) :
+        Compressor(Compressor), Max(Max), Built(false), Private(false), Base(0) {}
+};
+
+void PyTarFile_InitIndex(PyTarFileObject *tarfile, const char *comp,
+                         unsigned long long max)
+{
+    tarfile->index = new PyTarIndex(comp, max);
+}
+
+static void tarfile_dealloc(PyObject *self)
+{
+    delete ((PyTarFileObject*)self)->index;
+    CppDealloc<ExtractTar*>(self);
+}
+
+// Open the reader at the start of the archive, like ExtractTar does.
+bool PyTarIndex::Open(int Fd, unsigned long long Min)
+{
+    In.Close();
+    // Reopen the file, so the reader's offset is not changed by others.
+    int InFd = open(("/proc/self/fd/" + std::to_string(Fd)).c_str(),
+                    O_RDONLY|O_CLOEXEC);
+    Private = InFd != -1;
+    if (Private == false)
+        InFd = dup(Fd);
+    if (InFd == -1)
+        return _error->Errno("dup", "Could not open the archive");
+    if (lseek(InFd, Min, SEEK_SET) == -1) {
+        close(InFd);
+        return _error->Errno("lseek", "Could not seek in the archive");
+    }
+
+    bool Res = false;
+    if (Compressor.empty()) {
+        Res = In.OpenDescriptor(InFd, FileFd::ReadOnly, FileFd::None, true);
+    } else {
+        for (auto const &C : APT::Configuration::getCompressors())
+            if (C.Name == Compressor) {
+                Res = In.OpenDescriptor(InFd, FileFd::ReadOnly, C, true);
+                break;
+            }
+        if (In.IsOpen() == false) {
+            close(InFd);
+            return _error->Error("Cannot find a configured compressor for '%s'",
+                                 Compressor.c_str());
+        }
+    }
+    // Uncompressed files report the offset in the file, not the archive.
+    Base = In.Tell();
+    return Res;
+}
+
+// Parse a numeric field of a tar header, in octal or base-256.
+static unsigned long long tar_number(const char *Field, size_t Length)
+{
+    unsigned long long Res = 0;
+    if ((unsigned char) Field[0] & 0x80) {
+        for (size_t I = 1; I < Length; I++)
+            Res = (Res << 8) | (unsigned char) Field[I];
+        return Res;
+    }
+    for (size_t I = 0; I < Length; I++) {
+        if (Field[I] >= '0' && Field[I] <= '7')
+            Res = Res * 8 + (Field[I] - '0');
+        else if (Field[I] != ' ' || Res != 0)
+            break;
+    }
+    return Res;
+}
+
+bool PyTarIndex::Build(int Fd, unsigned long long Min)
+{
+    Members.clear();
+    Built = false;
+    if (Open(Fd, Min) == false)
+        return false;
+
+    std::string LongName;
+    char Block[512];
+    // Max is the size of the compressed data, while Pos() counts the
+    // decompressed data, so it only bounds uncompressed archives.
+    while (Compressor.empty() == false || Pos() + sizeof(Block) <= Max) {
+        unsigned long long Actual;
+        if (In.Read(Block, sizeof(Block), &Actual) == false)
+            return false;
+        // The archive ends with blocks of zeros, or with the data if they
+        // are missing, which ExtractTar accepts as well.
+        if (Actual == 0 || Block[0] == 0)
+            break;
+        if (Actual != sizeof(Block))
+            return _error->Error("Unexpected end of the archive");
+
+        // Verify the header like ExtractTar does.
+        unsigned long long Checksum = tar_number(Block + 148, 8);
+        memset(Block + 148, ' ', 8);
+        unsigned long long Sum = 0;
+        for (size_t I = 0; I < sizeof(Block); I++)
+            Sum += (unsigned char) Block[I];
+        if (Sum != Checksum)
+            return _error->Error("Tar checksum failed, archive corrupted");
+
+        Entry E;
+        E.Size = tar_number(Block + 124, 12);
+        E.Offset = Pos();
+        unsigned long long Padded = (E.Size + 511) / 512 * 512;
+        char Type = Block[156];
+
+        if (Type == 'L') {
+            // GNU long name for the next member. The size comes from the
+            // archive, so do not allocate more than a path can take.
+            if (E.Size > PATH_MAX)
+                return _error->Error("The long name of a member is too long "
+                                     "(%llu bytes)", E.Size);
+            LongName.resize(E.Size);
+            if (In.Read(&LongName[0], E.Size) == false ||
+                In.Skip(Padded - E.Size) == false)
+                return false;
+            LongName.resize(strnlen(LongName.c_str(), E.Size));
+            continue;
+        }
+        if (In.Skip(Padded) == false)
+            return false;
+        // Long link targets, extended headers and such are not members.
+        if (Type == 'K' || Type == 'x' || Type == 'g')
+            continue;
+
+        // Like ExtractTar, the ustar prefix field is not part of the name,
+        // so that the index has the names getnames() returns.
+        std::string Name = LongName.empty() ?
+                           std::string(Block, strnlen(Block, 100)) : LongName;
+        LongName.clear();
+        // ExtractTar strips a leading "./" as well.
+        if (Name.size() > 2 && Name.compare(0, 2, "./") == 0)
+            Name.erase(0, 2);
+        // Links and such have no data, but ExtractTar reads them as empty.
+        if (Type != 0 && Type != '0' && Type != '7')
+            E.Size = 0;
+        Members[Name] = E;
+    }
+    Built = true;
+    return true;
+}
+
+// Read the data of E into Buffer.
+bool PyTarIndex::Read(int Fd, unsigned long long Min, Entry const &E,
+                      char *Buffer)
+{
+    if (Compressor.empty()) {
+        for (unsigned long long Done = 0; Done < E.Size;) {
+            ssize_t Res = pread(Fd, Buffer + Done, E.Size - Done,
+                                Min + E.Offset + Done);
+            if (Res < 0 && errno == EINTR)
+                continue;
+            if (Res <= 0)
+                return _error->Errno("pread", "Could not read the archive");
+            Done += Res;
+        }
+        return true;
+    }
+
+    if (In.IsOpen() == false || Private == false || Pos() > E.Offset)
+        if (Open(Fd, Min) == false)
+            return false;
+    return In.Skip(E.Offset - Pos()) && In.Read(Buffer, E.Size);
+}
+
 static PyObject *tarfile_new(PyTypeObject *type,PyObject *args,PyObject *kwds)
 {
     PyObject *file;
@@ -370,61 +1237,114 @@ static PyObject *tarfile_new(PyTypeObject *type,PyObject *args,PyObject *kwds)
 
     self->min = min;
     self->Object = new ExtractTar(self->Fd,max,comp);
+    PyTarFile_InitIndex(self, comp, (unsigned int) max);
     if (_error->PendingError() == true)
         return HandleErrors(self);
     return self;
 }
 
+// Seek to the start of the archive, unless a member reader is using it.
+static bool tarfile_rewind(PyObject *self)
+{
+    PyTarFileObject *tarfile = (PyTarFileObject*)self;
+    if (tarfile->busy) {
+        PyErr_SetString(PyExc_ValueError,
+                        "The archive is in use by an open member reader "
+                        "or another thread");
+        return false;
+    }
+    tarfile->Fd.Seek(tarfile->min);
+    return true;
+}
+
+static const char *tarfile_build_index_doc =
+    "build_index() -> int\n\n"
+    "Read the archive once and record where the data of each member is.\n"
+    "Later calls to extractdata() use this index instead of reading\n"
+    "through the archive. Return the number of members.";
+static PyObject *tarfile_build_index(PyObject *self, PyObject *args)
+{
+    if (tarfile_rewind(self) == false)
+        return 0;
+    PyTarFileObject *tarfile = (PyTarFileObject*)self;
+    bool res;
+    // Keep other threads from using the index while it is rebuilt.
+    tarfile->busy = true;
+    Py_BEGIN_ALLOW_THREADS
+    try {
+        res = tarfile->index->Build(tarfile->Fd.Fd(), tarfile->min);
+    } catch (std::exception const &e) {
+        // Such as std::bad_alloc, which must not end the process
+        res = _error->Error("Could not index the archive: %s", e.what());
+    }
+    Py_END_ALLOW_THREADS
+    tarfile->busy = false;
+    if (res == false)
+        return HandleErrors();
+    return MkPyNumber((unsigned long long) tarfile->index->Members.size());
+}
+
 static const char *tarfile_extractall_doc =
     "extractall([rootdir: str]) -> True\n\n"
     "Extract the archive in the current directory. The argument 'rootdir'\n"
-    "can be used to change the target directory.";
+    "can be used to change the target directory. Members which would be\n"
+    "created outside of it raise an error.";
 static PyObject *tarfile_extractall(PyObject *self, PyObject *args)
 {
-    std::string cwd = SafeGetCWD();
     PyApt_Filename rootdir;
     if (PyArg_ParseTuple(args,"|O&:extractall", PyApt_Filename::Converter, &rootdir) == 0)
         return 0;
 
-    if (rootdir) {
-        if (chdir(rootdir) == -1)
-            return PyErr_SetFromErrnoWithFilename(PyExc_OSError, rootdir);
-    }
-
-    pkgDirStream Extract;
-
-    ((PyTarFileObject*)self)->Fd.Seek(((PyTarFileObject*)self)->min);
-    bool res = GetCpp<ExtractTar*>(self)->Go(Extract);
+    if (tarfile_rewind(self) == false)
+        return 0;
 
+    const char *dir = rootdir ? rootdir.path : ".";
+    int dirfd = open(dir, O_RDONLY|O_DIRECTORY|O_CLOEXEC);
+    if (dirfd == -1)
+        return PyErr_SetFromErrnoWithFilename(PyExc_OSError, dir);
 
+    // The extraction does not call into Python, so allow other threads to
+    // run, but keep them from using the archive in the meantime.
+    PyTarFileObject *tarfile = (PyTarFileObject*)self;
+    bool res;
+    tarfile->busy = true;
+    Py_BEGIN_ALLOW_THREADS
+    PyExtractStream Extract(dirfd);
+    res = GetCpp<ExtractTar*>(self)->Go(Extract);
+    Py_END_ALLOW_THREADS
+    tarfile->busy = false;
+    close(dirfd);
 
-    if (rootdir) {
-        if (chdir(cwd.c_str()) == -1)
-            return PyErr_SetFromErrnoWithFilename(PyExc_OSError,
-                                                  (char*)cwd.c_str());
-    }
     return HandleErrors(PyBool_FromLong(res));
 }
 
 static const char *tarfile_go_doc =
-    "go(callback: callable[, member: str]) -> True\n\n"
+    "go(callback: callable[, member: str, with_data: bool = True]) -> True\n\n"
     "Go through the archive and call the callable 'callback' for each\n"
     "member with 2 arguments. The first argument is the TarMember and\n"
     "the second one is the data, as bytes.\n\n"
     "The optional parameter 'member' can be used to specify the member for\n"
     "which to call the callback. If not specified, it will be called for all\n"
-    "members. If specified and not found, LookupError will be raised.";
-static PyObject *tarfile_go(PyObject *self, PyObject *args)
+    "members. If specified and not found, LookupError will be raised.\n\n"
+    "If 'with_data' is False, the data is skipped without being copied\n"
+    "and None is passed as the second argument.";
+static PyObject *tarfile_go(PyObject *self, PyObject *args, PyObject *kwds)
 {
     PyObject *callback;
     PyApt_Filename member;
-    if (PyArg_ParseTuple(args,"O|O&",&callback, PyApt_Filename::Converter, &member) == 0)
+    char with_data = 1;
+    static char *kwlist[] = {"callback", "member", "with_data", NULL};
+    if (PyArg_ParseTupleAndKeywords(args, kwds, "O|O&b", kwlist, &callback,
+                                    PyApt_Filename::Converter, &member,
+                                    &with_data) == 0)
         return 0;
     if (member && strcmp(member, "") == 0)
         member = 0;
     pkgDirStream Extract;
     PyDirStream stream(callback, member);
-    ((PyTarFileObject*)self)->Fd.Seek(((PyTarFileObject*)self)->min);
+    stream.with_data = with_data;
+    if (tarfile_rewind(self) == false)
+        return 0;
     bool res = GetCpp<ExtractTar*>(self)->Go(stream);
     if (stream.error)
         return 0;
@@ -437,14 +1357,46 @@ static PyObject *tarfile_go(PyObject *self, PyObject *args)
 static const char *tarfile_extractdata_doc =
     "extractdata(member: str) -> bytes\n\n"
     "Return the contents of the member, as a bytes object. Raise\n"
-    "LookupError if there is no member with the given name.";
+    "LookupError if there is no member with the given name.\n\n"
+    "After build_index() was called, the member is looked up in the index\n"
+    "instead of reading the archive up to it.";
 static PyObject *tarfile_extractdata(PyObject *self, PyObject *args)
 {
     PyApt_Filename member;
     if (PyArg_ParseTuple(args,"O&", PyApt_Filename::Converter, &member) == 0)
         return 0;
     PyDirStream stream(NULL, member);
-    ((PyTarFileObject*)self)->Fd.Seek(((PyTarFileObject*)self)->min);
+    if (tarfile_rewind(self) == false)
+        return 0;
+
+    PyTarFileObject *tarfile = (PyTarFileObject*)self;
+    if (tarfile->index->Built) {
+        auto entry = tarfile->index->Members.find(member.path);
+        if (entry == tarfile->index->Members.end())
+            return PyErr_Format(PyExc_LookupError,
+                                "There is no member named '%s'", member.path);
+        if (entry->second.Size > PY_SSIZE_T_MAX)
+            return PyErr_Format(PyExc_MemoryError,
+                                "The member %s was too large to read into memory",
+                                member.path);
+        PyObject *data = PyBytes_FromStringAndSize(NULL, entry->second.Size);
+        if (data == NULL)
+            return 0;
+        bool res;
+        // The reader of the index is shared, and entry points into it.
+        tarfile->busy = true;
+        Py_BEGIN_ALLOW_THREADS
+        res = tarfile->index->Read(tarfile->Fd.Fd(), tarfile->min,
+                                   entry->second, PyBytes_AS_STRING(data));
+        Py_END_ALLOW_THREADS
+        tarfile->busy = false;
+        if (res == false) {
+            Py_DECREF(data);
+            return HandleErrors();
+        }
+        return data;
+    }
+
     // Go through the stream.
     GetCpp<ExtractTar*>(self)->Go(stream);
 
@@ -457,10 +1409,222 @@ static PyObject *tarfile_extractdata(PyObject *self, PyObject *args)
     return Py_INCREF(stream.py_data), stream.py_data;
 }
 
+static PyObject *_getmembers(PyObject *self, bool names)
+{
+    PyMemberListStream stream(names);
+    if (stream.list == NULL)
+        return 0;
+    if (tarfile_rewind(self) == false)
+        return 0;
+    bool res = GetCpp<ExtractTar*>(self)->Go(stream);
+    if (PyErr_Occurred())
+        return 0;
+    if (res == false)
+        return HandleErrors();
+    return Py_INCREF(stream.list), stream.list;
+}
+
+static const char *tarfile_getmembers_doc =
+    "getmembers() -> list\n\n"
+    "Return a list of TarMember objects for all members in the archive.\n"
+    "The data of the members is skipped without being read into memory.";
+static PyObject *tarfile_getmembers(PyObject *self, PyObject *args)
+{
+    return _getmembers(self, false);
+}
+
+static const char *tarfile_getnames_doc =
+    "getnames() -> list\n\n"
+    "Return a list of the names of all members in the archive.";
+static PyObject *tarfile_getnames(PyObject *self, PyObject *args)
+{
+    return _getmembers(self, true);
+}
+
+static const char *tarfile_extract_members_doc =
+    "extract_members([names: list]) -> dict\n\n"
+    "Return a dict mapping the names of the members in 'names' to their\n"
+    "contents, as bytes, reading the archive only once. Members which do\n"
+    "not exist are left out. If 'names' is not given, all regular files\n"
+    "are returned.";
+static PyObject *tarfile_extract_members(PyObject *self, PyObject *args)
+{
+    PyObject *names = Py_None;
+    if (PyArg_ParseTuple(args, "|O:extract_members", &names) == 0)
+        return 0;
+
+    std::set<std::string> wanted;
+    if (names != Py_None) {
+        PyObject *seq = PySequence_Fast(names, "names must be a sequence");
+        if (seq == NULL)
+            return 0;
+        Py_ssize_t len = PySequence_Fast_GET_SIZE(seq);
+        for (Py_ssize_t i = 0; i < len; i++) {
+            PyApt_Filename name;
+            if (!name.init(PySequence_Fast_GET_ITEM(seq, i))) {
+                Py_DECREF(seq);
+                return 0;
+            }
+            wanted.insert(name.path);
+        }
+        Py_DECREF(seq);
+        if (wanted.empty())
+            return PyDict_New();
+    }
+
+    PyMemberDictStream stream(names != Py_None ? &wanted : NULL);
+    if (stream.dict == NULL)
+        return 0;
+    if (tarfile_rewind(self) == false)
+        return 0;
+    bool res = GetCpp<ExtractTar*>(self)->Go(stream);
+    if (PyErr_Occurred())
+        return 0;
+    if (res == false && stream.complete == false)
+        return HandleErrors();
+    return Py_INCREF(stream.dict), stream.dict;
+}
+
+bool PyTarFile_HashMembers(PyObject *self, unsigned int types,
+                           std::map<std::string, HashStringList> &hashes)
+{
+    if (tarfile_rewind(self) == false)
+        return false;
+    PyTarFileObject *tarfile = (PyTarFileObject*)self;
+    PyHashStream stream(types, hashes);
+    bool res;
+    tarfile->busy = true;
+    Py_BEGIN_ALLOW_THREADS
+    res = GetCpp<ExtractTar*>(self)->Go(stream);
+    Py_END_ALLOW_THREADS
+    tarfile->busy = false;
+    if (res == false)
+        return HandleErrors(), false;
+    return true;
+}
+
+// Convert a HashStringList into an apt_pkg.HashStringList.
+static PyObject *tarfile_hashstringlist(HashStringList const &hashes)
+{
+    PyObject *list = PyObject_CallObject(PyAptHashStringList, NULL);
+    if (list == NULL)
+        return 0;
+    for (auto const &hash : hashes) {
+        PyObject *py_hash = PyObject_CallFunction(PyAptHashString, "ss",
+                                                  hash.HashType().c_str(),
+                                                  hash.HashValue().c_str());
+        PyObject *res = py_hash ? PyObject_CallMethod(list, "append", "(O)",
+                                                      py_hash) : NULL;
+        Py_XDECREF(py_hash);
+        if (res == NULL) {
+            Py_DECREF(list);
+            return 0;
+        }
+        Py_DECREF(res);
+    }
+    return list;
+}
+
+static const char *tarfile_hash_members_doc =
+    "hash_members([types: list]) -> dict\n\n"
+    "Return a dict mapping the names of the regular files in the archive\n"
+    "to an apt_pkg.HashStringList of their contents. The parameter 'types'\n"
+    "is a sequence of the hashes to calculate, out of 'md5', 'sha1',\n"
+    "'sha256' and 'sha512'; the default is ('md5', 'sha256'). Hard links\n"
+    "to a regular file have the hashes of that file.\n\n"
+    "The contents are hashed while decompressing the archive, without\n"
+    "copying them into Python objects.";
+static PyObject *tarfile_hash_members(PyObject *self, PyObject *args,
+                                      PyObject *kwds)
+{
+    PyObject *types = NULL;
+    char *kwlist[] = {"types", NULL};
+    if (PyArg_ParseTupleAndKeywords(args, kwds, "|O:hash_members", kwlist,
+                                    &types) == 0)
+        return 0;
+
+    unsigned int mask = Hashes::MD5SUM | Hashes::SHA256SUM;
+    if (types != NULL && HashTypesToMask(types, mask) == false)
+        return 0;
+
+    std::map<std::string, HashStringList> hashes;
+    if (PyTarFile_HashMembers(self, mask, hashes) == false)
+        return 0;
+
+    PyObject *dict = PyDict_New();
+    for (auto it = hashes.begin(); dict != NULL && it != hashes.end(); ++it) {
+        PyObject *name = CppPyPath(it->first);
+        PyObject *list = tarfile_hashstringlist(it->second);
+        if (name == NULL || list == NULL ||
+            PyDict_SetItem(dict, name, list) == -1)
+            Py_CLEAR(dict);
+        Py_XDECREF(name);
+        Py_XDECREF(list);
+    }
+    return dict;
+}
+
+static const char *tarfile_open_member_doc =
+    "open_member(member: str) -> TarMemberReader\n\n"
+    "Return a file-like object for reading the contents of the member\n"
+    "in chunks, without holding all of it in memory. Raise LookupError if\n"
+    "there is no member with the given name.\n\n"
+    "The other methods of the archive can not be used until the returned\n"
+    "object is closed.";
+static PyObject *tarfile_open_member(PyObject *self, PyObject *args)
+{
+    PyApt_Filename member;
+    if (PyArg_ParseTuple(args,"O&", PyApt_Filename::Converter, &member) == 0)
+        return 0;
+    if (tarfile_rewind(self) == false)
+        return 0;
+
+    PyTarFileObject *tarfile = (PyTarFileObject*)self;
+    TarMemberReader *reader = new TarMemberReader(GetCpp<ExtractTar*>(self),
+                                                  member.path);
+    // The worker reads the archive from now on, also while it is searched.
+    tarfile->busy = true;
+    try {
+        reader->Worker = std::thread(&TarMemberReader::Run, reader);
+    } catch (std::system_error &e) {
+        tarfile->busy = false;
+        delete reader;
+        return PyErr_Format(PyExc_OSError, "Could not start thread: %s",
+                            e.what());
+    }
+    Py_BEGIN_ALLOW_THREADS
+    reader->Wait();
+    Py_END_ALLOW_THREADS
+
+    if (reader->Found == false) {
+        // The thread already finished, so this does not block.
+        for (auto const &E : reader->Errors)
+            if (E.first)
+                _error->Error("%s", E.second.c_str());
+        bool failed = reader->Errors.empty() == false;
+        delete reader;
+        tarfile->busy = false;
+        if (failed)
+            return HandleErrors();
+        return PyErr_Format(PyExc_LookupError, "There is no member named '%s'",
+                            member.path);
+    }
+    return CppPyObject_NEW<TarMemberReader*>(self, &PyTarMemberReader_Type,
+                                             reader);
+}
+
 static PyMethodDef tarfile_methods[] = {
+    {"hash_members",reinterpret_cast<PyCFunction>(static_cast<PyCFunctionWithKeywords>(tarfile_hash_members)),METH_VARARGS|METH_KEYWORDS,
+     tarfile_hash_members_doc},
+    {"build_index",tarfile_build_index,METH_NOARGS,tarfile_build_index_doc},
     {"extractdata",tarfile_extractdata,METH_VARARGS,tarfile_extractdata_doc},
     {"extractall",tarfile_extractall,METH_VARARGS,tarfile_extractall_doc},
-    {"go",tarfile_go,METH_VARARGS,tarfile_go_doc},
+    {"extract_members",tarfile_extract_members,METH_VARARGS,
+     tarfile_extract_members_doc},
+    {"getmembers",tarfile_getmembers,METH_NOARGS,tarfile_getmembers_doc},
+    {"getnames",tarfile_getnames,METH_NOARGS,tarfile_getnames_doc},
+    {"go",(PyCFunction)tarfile_go,METH_VARARGS|METH_KEYWORDS,tarfile_go_doc},
+    {"open_member",tarfile_open_member,METH_VARARGS,tarfile_open_member_doc},
     {NULL}
 };
 
@@ -485,7 +1649,7 @@ PyTypeObject PyTarFile_Type = {
     sizeof(PyTarFileObject),             // tp_basicsize
     0,                                   // tp_itemsize
     // Methods
-    CppDealloc<ExtractTar*>,        // tp_dealloc
+    tarfile_dealloc,                     // tp_dealloc
     0,                                   // tp_print
     0,                                   // tp_getattr
     0,                                   // tp_setattr
@@ -521,3 +1685,202 @@ PyTypeObject PyTarFile_Type = {
     0,                                   // tp_alloc
     tarfile_new                          // tp_new
 };
+
+// Close the reader and release the archive. Returns false if it was
+// already closed.
+static bool tarmemberreader_close_reader(PyObject *self)
+{
+    TarMemberReader *reader = GetCpp<TarMemberReader*>(self);
+    if (reader->Closed)
+        return false;
+    Py_BEGIN_ALLOW_THREADS
+    reader->Close();
+    Py_END_ALLOW_THREADS
+    ((PyTarFileObject*)GetOwner<TarMemberReader*>(self))->busy = false;
+    return true;
+}
+
+static void tarmemberreader_dealloc(PyObject *self)
+{
+    tarmemberreader_close_reader(self);
+    CppDeallocPtr<TarMemberReader*>(self);
+}
+
+// Read into the buffer, and raise an error if the data ended early.
+static Py_ssize_t tarmemberreader_read_into(PyObject *self, char *buffer,
+                                            size_t length)
+{
+    TarMemberReader *reader = GetCpp<TarMemberReader*>(self);
+    if (reader->Closed) {
+        PyErr_SetString(PyExc_ValueError, "I/O operation on closed file.");
+        return -1;
+    }
+    size_t read;
+    Py_BEGIN_ALLOW_THREADS
+    read = reader->ReadInto(buffer, length);
+    Py_END_ALLOW_THREADS
+    if (read < length && reader->Pos < reader->Size) {
+        for (auto const &E : reader->Errors)
+            if (E.first)
+                _error->Error("%s", E.second.c_str());
+        reader->Errors.clear();
+        _error->Error("Unexpected end of data for member %s",
+                      reader->Name.c_str());
+        HandleErrors();
+        return -1;
+    }
+    return read;
+}
+
+static const char *tarmemberreader_read_doc =
+    "read([size: int]) -> bytes\n\n"
+    "Read at most 'size' bytes of the member, or all of the remaining\n"
+    "data if 'size' is negative or not given. Return an empty bytes\n"
+    "object at the end of the member.";
+static PyObject *tarmemberreader_read(PyObject *self, PyObject *args)
+{
+    TarMemberReader *reader = GetCpp<TarMemberReader*>(self);
+    Py_ssize_t size = -1;
+    if (PyArg_ParseTuple(args, "|n:read", &size) == 0)
+        return 0;
+
+    unsigned long long left = 0;
+    if (reader->Pos < reader->Size)
+        left = reader->Size - reader->Pos;
+    if (size < 0 || (unsigned long long) size > left) {
+        if (left > PY_SSIZE_T_MAX)
+            return PyErr_NoMemory();
+        size = left;
+    }
+
+    PyObject *result = PyBytes_FromStringAndSize(NULL, size);
+    if (result == NULL)
+        return 0;
+    Py_ssize_t read = tarmemberreader_read_into(self,
+                                                PyBytes_AS_STRING(result),
+                                                size);
+    if (read == -1) {
+        Py_DECREF(result);
+        return 0;
+    }
+    if (read < size && _PyBytes_Resize(&result, read) == -1)
+        return 0;
+    return result;
+}
+
+static const char *tarmemberreader_readinto_doc =
+    "readinto(buffer) -> int\n\n"
+    "Read data of the member directly into the writable buffer and return\n"
+    "the number of bytes read, which is 0 at the end of the member.";
+static PyObject *tarmemberreader_readinto(PyObject *self, PyObject *args)
+{
+    Py_buffer buffer;
+    if (PyArg_ParseTuple(args, "w*:readinto", &buffer) == 0)
+        return 0;
+    Py_ssize_t read = tarmemberreader_read_into(self, (char *) buffer.buf,
+                                                buffer.len);
+    PyBuffer_Release(&buffer);
+    if (read == -1)
+        return 0;
+    return MkPyNumber((long) read);
+}
+
+static PyObject *tarmemberreader_readable(PyObject *self, PyObject *args)
+{
+    Py_RETURN_TRUE;
+}
+
+static const char *tarmemberreader_close_doc =
+    "close()\n\n"
+    "Close the reader, so the archive can be used again.";
+static PyObject *tarmemberreader_close(PyObject *self, PyObject *args)
+{
+    tarmemberreader_close_reader(self);
+    Py_RETURN_NONE;
+}
+
+static PyObject *tarmemberreader_enter(PyObject *self, PyObject *args)
+{
+    Py_INCREF(self);
+    return self;
+}
+
+static PyObject *tarmemberreader_exit(PyObject *self, PyObject *args)
+{
+    tarmemberreader_close_reader(self);
+    Py_RETURN_FALSE;
+}
+
+static PyMethodDef tarmemberreader_methods[] = {
+    {"read",tarmemberreader_read,METH_VARARGS,tarmemberreader_read_doc},
+    {"readinto",tarmemberreader_readinto,METH_VARARGS,
+     tarmemberreader_readinto_doc},
+    {"readable",tarmemberreader_readable,METH_NOARGS,
+     "readable() -> True"},
+    {"close",tarmemberreader_close,METH_NOARGS,tarmemberreader_close_doc},
+    {"__enter__",tarmemberreader_enter,METH_NOARGS,
+     "Context manager entry, return the reader itself."},
+    {"__exit__",tarmemberreader_exit,METH_VARARGS,
+     "Context manager exit, close the reader."},
+    {NULL}
+};
+
+static PyObject *tarmemberreader_get_closed(PyObject *self, void *closure)
+{
+    return PyBool_FromLong(GetCpp<TarMemberReader*>(self)->Closed);
+}
+
+static PyObject *tarmemberreader_get_name(PyObject *self, void *closure)
+{
+    return CppPyPath(GetCpp<TarMemberReader*>(self)->Name);
+}
+
+static PyObject *tarmemberreader_get_size(PyObject *self, void *closure)
+{
+    return MkPyNumber(GetCpp<TarMemberReader*>(self)->Size);
+}
+
+static PyGetSetDef tarmemberreader_getset[] = {
+    {"closed",tarmemberreader_get_closed,0,"Whether the reader is closed."},
+    {"name",tarmemberreader_get_name,0,"The name of the member."},
+    {"size",tarmemberreader_get_size,0,"The size of the member."},
+    {NULL}
+};
+
+static const char *tarmemberreader_doc =
+    "A file-like object for reading a member of a TarFile.\n\n"
+    "Objects of this class are returned by TarFile.open_member(). The data\n"
+    "is decompressed on demand, one chunk at a time.";
+PyTypeObject PyTarMemberReader_Type = {
+    PyVarObject_HEAD_INIT(&PyType_Type, 0)
+    "apt_inst.TarMemberReader",          // tp_name
+    sizeof(CppPyObject<TarMemberReader*>), // tp_basicsize
+    0,                                   // tp_itemsize
+    // Methods
+    tarmemberreader_dealloc,             // tp_dealloc
+    0,                                   // tp_print
+    0,                                   // tp_getattr
+    0,                                   // tp_setattr
+    0,                                   // tp_compare
+    0,                                   // tp_repr
+    0,                                   // tp_as_number
+    0,                                   // tp_as_sequence
+    0,                                   // tp_as_mapping
+    0,                                   // tp_hash
+    0,                                   // tp_call
+    0,                                   // tp_str
+    0,                                   // tp_getattro
+    0,                                   // tp_setattro
+    0,                                   // tp_as_buffer
+    Py_TPFLAGS_DEFAULT,                  // tp_flags
+    tarmemberreader_doc,                 // tp_doc
+    0,                                   // tp_traverse
+    0,                                   // tp_clear
+    0,                                   // tp_richcompare
+    0,                                   // tp_weaklistoffset
+    0,                                   // tp_iter
+    0,                                   // tp_iternext
+    tarmemberreader_methods,             // tp_methods
+    0,                                   // tp_members
+    tarmemberreader_getset               // tp_getset
+};
@@ -77,7 +77,7 @@ apt_pkg = Extension("apt_pkg", files, libraries=["apt-pkg"],
 
 # The apt_inst module
 files = ["python/apt_instmodule.cc", "python/generic.cc",
-         "python/arfile.cc", "python/tarfile.cc"]
+         "python/arfile.cc", "python/tarfile.cc", "python/debscan.cc"]
 apt_inst = Extension("apt_inst", files, libraries=["apt-pkg"],
                      extra_compile_args=['-std=c++11', '-Wno-write-strings',
                                          '-DPY_SSIZE_T_CLEAN'])
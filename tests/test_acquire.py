@@ -0,0 +1,317 @@
+#!/usr/bin/python3
+#
+# Copying and distribution of this file, with or without modification,
+# are permitted in any medium without royalty provided the copyright
+# notice and this notice are preserved.
+"""Unit tests for apt_pkg.Acquire"""
+import asyncio
+import hashlib
+import os
+import select
+import shutil
+import tempfile
+import threading
+import unittest
+
+import apt
+import apt_pkg
+
+import testcommon
+
+
+class CountingProgress(apt.progress.base.AcquireProgress):
+    def __init__(self):
+        apt.progress.base.AcquireProgress.__init__(self)
+        self.calls = []
+
+    def start(self):
+        self.calls.append("start")
+
+    def stop(self):
+        self.calls.append("stop")
+
+    def pulse(self, owner):
+        self.calls.append("pulse")
+        return True
+
+    def fetch(self, item):
+        self.calls.append("fetch")
+
+    def done(self, item):
+        self.calls.append("done")
+
+
+class TestAcquireEvents(testcommon.TestCase):
+
+    def setUp(self):
+        testcommon.TestCase.setUp(self)
+        self.tmpdir = tempfile.mkdtemp()
+        self.addCleanup(shutil.rmtree, self.tmpdir)
+        self.source = os.path.join(self.tmpdir, "source")
+        with open(self.source, "wb") as fobj:
+            fobj.write(b"x" * 4096)
+        # an item is removed from its fetcher when it is deallocated
+        self.items = []
+
+    def add_item(self, fetcher, name="dest"):
+        item = apt_pkg.AcquireFile(fetcher, "copy:" + self.source,
+                                   destdir=self.tmpdir,
+                                   destfile=os.path.join(self.tmpdir, name))
+        self.items.append(item)
+        return item
+
+    def test_events(self):
+        fetcher = apt_pkg.Acquire(events=True)
+        self.assertTrue(fetcher.event_fd >= 0)
+        self.add_item(fetcher)
+        self.assertEqual(fetcher.run(), fetcher.RESULT_CONTINUE)
+
+        events = fetcher.poll_events()
+        types = [event[0] for event in events]
+        self.assertEqual(types[0], "start")
+        self.assertEqual(types[-1], "stop")
+        done = [event for event in events if event[0] == "done"]
+        self.assertEqual(len(done), 1)
+        self.assertEqual(done[0][1], "copy:" + self.source)
+        self.assertEqual(fetcher.poll_events(), [])
+        with open(os.path.join(self.tmpdir, "dest"), "rb") as fobj:
+            self.assertEqual(fobj.read(), b"x" * 4096)
+
+    def test_events_from_thread(self):
+        fetcher = apt_pkg.Acquire(events=True)
+        self.add_item(fetcher)
+        result = []
+        thread = threading.Thread(target=lambda: result.append(fetcher.run()))
+        thread.start()
+        events = []
+        while thread.is_alive():
+            select.select([fetcher.event_fd], [], [], 0.1)
+            events.extend(fetcher.poll_events())
+        thread.join()
+        events.extend(fetcher.poll_events())
+        self.assertEqual(result, [fetcher.RESULT_CONTINUE])
+        self.assertIn("done", [event[0] for event in events])
+
+    def test_run_async(self):
+        fetcher = apt_pkg.Acquire(events=True)
+        self.add_item(fetcher)
+
+        async def main():
+            events = []
+            loop = asyncio.get_running_loop()
+            loop.add_reader(fetcher.event_fd,
+                            lambda: events.extend(fetcher.poll_events()))
+            try:
+                result = await fetcher.run_async()
+            finally:
+                loop.remove_reader(fetcher.event_fd)
+            events.extend(fetcher.poll_events())
+            return result, events
+
+        loop = asyncio.new_event_loop()
+        self.addCleanup(loop.close)
+        result, events = loop.run_until_complete(main())
+        self.assertEqual(result, fetcher.RESULT_CONTINUE)
+        self.assertEqual([event[0] for event in events
+                          if event[0] in ("start", "done", "stop")],
+                         ["start", "done", "stop"])
+
+        fetcher = apt_pkg.Acquire(apt.progress.base.AcquireProgress())
+        self.assertRaises(ValueError, fetcher.run_async)
+
+    def test_stats(self):
+        fetcher = apt_pkg.Acquire()
+        self.assertEqual(len(fetcher.stats), len(fetcher.STATS_FIELDS))
+        self.assertEqual(bytes(memoryview(fetcher)), bytes(fetcher.stats))
+        self.add_item(fetcher)
+        self.assertEqual(fetcher.run(), fetcher.RESULT_CONTINUE)
+        stats = dict(zip(fetcher.STATS_FIELDS, fetcher.stats))
+        self.assertEqual(stats["done_items"], 1)
+        self.assertEqual(stats["failed_items"], 0)
+        self.assertTrue(stats["fetched_bytes"] >= 0)
+
+    def test_item_stats(self):
+        fetcher = apt_pkg.Acquire()
+        self.assertEqual(fetcher.item_stats(), [])
+        self.add_item(fetcher, "dest1")
+        self.add_item(fetcher, "dest2")
+        self.assertEqual(fetcher.run(), fetcher.RESULT_CONTINUE)
+        stats = fetcher.item_stats()
+        self.assertEqual(len(stats), 2)
+        for item in stats:
+            self.assertEqual(item["status"], "done")
+            self.assertEqual(item["method"], "copy")
+            self.assertEqual(item["uri"], "copy:" + self.source)
+            self.assertEqual(item["bytes"], 4096)
+            self.assertEqual(item["retries"], 0)
+            self.assertTrue(item["queued"] <= item["started"] <=
+                            item["finished"])
+
+    def test_item_stats_deleted_item(self):
+        fetcher = apt_pkg.Acquire()
+        self.add_item(fetcher, "dest1")
+        self.assertEqual(fetcher.run(), fetcher.RESULT_CONTINUE)
+        # a new item may be allocated at the address of the deleted one
+        del self.items[:]
+        self.add_item(fetcher, "dest2")
+        self.assertEqual(fetcher.run(), fetcher.RESULT_CONTINUE)
+        stats = fetcher.item_stats()
+        self.assertEqual(len(stats), 2)
+        for item in stats:
+            self.assertEqual(item["status"], "done")
+            self.assertEqual(item["retries"], 0)
+
+    def test_struct_progress(self):
+        progress = CountingProgress()
+        fetcher = apt_pkg.Acquire(progress, stats_interval=3600)
+        self.add_item(fetcher, "dest1")
+        self.add_item(fetcher, "dest2")
+        self.assertEqual(fetcher.run(), fetcher.RESULT_CONTINUE)
+        # no item callbacks, and at most one pulse per interval
+        self.assertEqual(progress.calls[0], "start")
+        self.assertEqual(progress.calls[-1], "stop")
+        self.assertNotIn("done", progress.calls)
+        self.assertNotIn("fetch", progress.calls)
+        self.assertTrue(progress.calls.count("pulse") <= 1)
+        stats = dict(zip(fetcher.STATS_FIELDS, fetcher.stats))
+        self.assertEqual(stats["done_items"], 2)
+
+    def test_acquire_file_large_size(self):
+        fetcher = apt_pkg.Acquire()
+        item = apt_pkg.AcquireFile(fetcher, "copy:" + self.source,
+                                   size=5 * 1024 ** 3,
+                                   destfile=os.path.join(self.tmpdir, "d"))
+        self.assertEqual(item.filesize, 5 * 1024 ** 3)
+        self.assertRaises(ValueError, apt_pkg.AcquireFile, fetcher,
+                          "copy:" + self.source, size=-1)
+
+    def test_acquire_file_received_hashes(self):
+        fetcher = apt_pkg.Acquire()
+        item = self.add_item(fetcher)
+        self.assertIsNone(item.received_hashes)
+        self.assertEqual(fetcher.run(), fetcher.RESULT_CONTINUE)
+        sha256 = item.received_hashes.find("SHA256")
+        self.assertEqual(sha256.hashvalue,
+                         hashlib.sha256(b"x" * 4096).hexdigest())
+
+    def test_scheduling_options(self):
+        apt_pkg.config.clear("Acquire::Queue-Mode")
+        apt_pkg.config.set("Acquire::http::Dl-Limit", "42")
+        fetcher = apt_pkg.Acquire(queue_mode="access", max_parallel=2,
+                                  rate_limit=1000)
+        self.add_item(fetcher)
+        self.assertEqual(fetcher.run(), fetcher.RESULT_CONTINUE)
+        # The options only apply while the fetcher uses them
+        self.assertFalse(apt_pkg.config.exists("Acquire::Queue-Mode"))
+        self.assertEqual(apt_pkg.config["Acquire::http::Dl-Limit"], "42")
+
+        self.assertRaises(ValueError, apt_pkg.Acquire, queue_mode="none")
+        self.assertRaises(ValueError, apt_pkg.Acquire, rate_limit=-1)
+
+    def test_scheduling_options_while_running(self):
+        errors = []
+
+        class OptionsProgress(CountingProgress):
+            def start(self):
+                CountingProgress.start(self)
+                # a running fetcher would see the options from its thread
+                for func in (lambda: apt_pkg.Acquire(queue_mode="access"),
+                             options.run):
+                    try:
+                        func()
+                    except RuntimeError:
+                        errors.append(func)
+
+        options = apt_pkg.Acquire(queue_mode="access")
+        fetcher = apt_pkg.Acquire(OptionsProgress())
+        self.add_item(fetcher)
+        self.assertEqual(fetcher.run(), fetcher.RESULT_CONTINUE)
+        self.assertEqual(len(errors), 2)
+        self.assertEqual(options.run(), options.RESULT_CONTINUE)
+
+    def test_fetcher_while_running(self):
+        errors = []
+
+        class ThreadProgress(CountingProgress):
+            def start(self):
+                CountingProgress.start(self)
+                # the callbacks may look at the fetcher, other threads not
+                self.items = fetcher.items
+                for func in (lambda: fetcher.items, lambda: fetcher.workers,
+                             lambda: fetcher.fetch_needed, fetcher.shutdown,
+                             lambda: apt_pkg.AcquireFile(fetcher, "copy:/x")):
+                    thread = threading.Thread(target=self.call, args=(func,))
+                    thread.start()
+                    thread.join()
+
+            def call(self, func):
+                try:
+                    func()
+                except RuntimeError:
+                    errors.append(func)
+
+        progress = ThreadProgress()
+        fetcher = apt_pkg.Acquire(progress)
+        self.add_item(fetcher)
+        self.assertEqual(fetcher.run(), fetcher.RESULT_CONTINUE)
+        self.assertEqual(len(progress.items), 1)
+        self.assertEqual(len(errors), 5)
+        self.assertEqual(len(fetcher.items), 1)
+
+    def test_content_cache(self):
+        cachedir = os.path.join(self.tmpdir, "cas")
+        apt_pkg.config["Acquire::Content-Cache"] = cachedir
+        sha256 = hashlib.sha256(b"x" * 4096).hexdigest()
+
+        fetcher = apt_pkg.Acquire()
+        item = apt_pkg.AcquireFile(fetcher, "copy:" + self.source,
+                                   hash="sha256:" + sha256, size=4096,
+                                   destfile=os.path.join(self.tmpdir, "first"))
+        self.assertEqual(fetcher.run(), fetcher.RESULT_CONTINUE)
+        stats = dict(zip(fetcher.STATS_FIELDS, fetcher.stats))
+        self.assertEqual(stats["cache_misses"], 1)
+        cached = os.path.join(cachedir, sha256[:2], sha256)
+        self.assertTrue(os.path.isfile(cached))
+
+        # A corrupt entry is a miss, and is replaced by the fetched file
+        os.unlink(cached)
+        with open(cached, "wb") as fobj:
+            fobj.write(b"y" * 4096)
+        fetcher = apt_pkg.Acquire()
+        item = apt_pkg.AcquireFile(fetcher, "copy:" + self.source,
+                                   hash="sha256:" + sha256, size=4096,
+                                   destfile=os.path.join(self.tmpdir, "bad"))
+        self.assertEqual(fetcher.run(), fetcher.RESULT_CONTINUE)
+        stats = dict(zip(fetcher.STATS_FIELDS, fetcher.stats))
+        self.assertEqual(stats["cache_misses"], 1)
+        with open(cached, "rb") as fobj:
+            self.assertEqual(fobj.read(), b"x" * 4096)
+
+        # The second fetcher does not need to fetch it
+        os.unlink(self.source)
+        fetcher = apt_pkg.Acquire()
+        dest = os.path.join(self.tmpdir, "second")
+        item = apt_pkg.AcquireFile(fetcher, "copy:" + self.source,
+                                   hash="sha256:" + sha256, size=4096,
+                                   destfile=dest)
+        self.assertEqual(fetcher.run(), fetcher.RESULT_CONTINUE)
+        self.assertTrue(item.complete)
+        self.assertEqual(item.received_hashes.find("sha256").hashvalue,
+                         sha256)
+        stats = dict(zip(fetcher.STATS_FIELDS, fetcher.stats))
+        self.assertEqual(stats["cache_hits"], 1)
+        self.assertEqual(stats["done_items"], 1)
+        self.assertEqual(stats["failed_items"], 0)
+        with open(dest, "rb") as fobj:
+            self.assertEqual(fobj.read(), b"x" * 4096)
+
+    def test_no_events(self):
+        fetcher = apt_pkg.Acquire()
+        self.assertEqual(fetcher.event_fd, -1)
+        self.assertRaises(ValueError, fetcher.poll_events)
+        self.assertRaises(ValueError, apt_pkg.Acquire,
+                          apt.progress.base.AcquireProgress(), events=True)
+
+
+if __name__ == "__main__":
+    unittest.main()
@@ -145,6 +145,120 @@ class TestAptCache(testcommon.TestCase):
         else:
             self.assertNotReached()
 
+    def test_records_lookup_many(self):
+        apt.apt_pkg.config.set("Apt::architecture", "i386")
+        cache = apt.Cache(rootdir="./data/test-provides")
+        if len(cache) == 0:
+            logging.warning(
+                "skipping test_records_lookup_many, cache empty?!?")
+            return
+        records = cache._records
+        pairs = [pkg.candidate._cand.file_list[0]
+                 for pkg in cache if pkg.candidate]
+        # request the records in reverse order
+        pairs.reverse()
+        fields = ["Package", "Maintainer", "X-Does-Not-Exist"]
+        results = records.lookup_many(pairs, fields)
+        self.assertEqual(len(results), len(pairs))
+        for pair, result in zip(pairs, results):
+            records.lookup(pair)
+            self.assertEqual(result, (records["Package"],
+                                      records["Maintainer"], ""))
+        self.assertRaises(IndexError, records.lookup_many,
+                          [(pairs[0][0], -1)], fields)
+
+    def test_records_field_cache(self):
+        apt.apt_pkg.config.set("Apt::architecture", "i386")
+        cache = apt.Cache(rootdir="./data/test-provides")
+        if len(cache) == 0:
+            logging.warning(
+                "skipping test_records_field_cache, cache empty?!?")
+            return
+        records = cache._records
+        postfix = cache["postfix"].candidate._cand.file_list[0]
+        other = cache["exim4-daemon-light"].candidate._cand.file_list[0]
+        records.lookup(postfix)
+        desc = records.long_desc
+        self.assertIs(records.long_desc, desc)
+        self.assertEqual(records["Package"], "postfix")
+        records.lookup(postfix)
+        self.assertIs(records.long_desc, desc)
+        records.lookup(other)
+        self.assertEqual(records["Package"], "exim4-daemon-light")
+        self.assertNotEqual(records.long_desc, desc)
+        self.assertTrue("Package" in records)
+        self.assertFalse("X-Does-Not-Exist" in records)
+
+    def test_depcache_changes_since(self):
+        apt.apt_pkg.config.set("Apt::architecture", "i386")
+        cache = apt.Cache(rootdir="./data/test-provides")
+        if len(cache) == 0:
+            logging.warning(
+                "skipping test_depcache_changes_since, cache empty?!?")
+            return
+        depcache = cache._depcache
+        token, changed = depcache.changes_since()
+        self.assertEqual(changed, [])
+        self.assertEqual(depcache.changes_since(token), (token, []))
+
+        cache["postfix"].mark_install()
+        new_token, changed = depcache.changes_since(token)
+        self.assertTrue(new_token > token)
+        self.assertIn("postfix", [p.name for p in changed])
+        self.assertEqual(len(changed), len(set(p.id for p in changed)))
+        self.assertEqual(depcache.changes_since(new_token), (new_token, []))
+
+        # an older token still sees the change
+        self.assertIn("postfix",
+                      [p.name for p in depcache.changes_since(token)[1]])
+        self.assertRaises(ValueError, depcache.changes_since, new_token + 1)
+
+    def test_cache_source_map(self):
+        apt.apt_pkg.config.set("Apt::architecture", "i386")
+        cache = apt.Cache(rootdir="./data/test-provides")
+        if len(cache) == 0:
+            logging.warning(
+                "skipping test_cache_source_map, cache empty?!?")
+            return
+        tmpdir = tempfile.mkdtemp()
+        self.addCleanup(shutil.rmtree, tmpdir)
+        self.addCleanup(apt_pkg.config.set, "Dir::Cache::pkgcache",
+                        apt_pkg.config.find("Dir::Cache::pkgcache"))
+        apt_pkg.config.set("Dir::Cache::pkgcache",
+                           os.path.join(tmpdir, "pkgcache.bin"))
+
+        srcmap = cache._cache.source_map()
+        self.assertTrue(os.path.exists(
+            os.path.join(tmpdir, "pkgcache.bin.srcmap")))
+        self.assertEqual(len(srcmap["source"]), cache._cache.version_count)
+        self.assertEqual(len(srcmap["offsets"]), len(srcmap["sources"]) + 1)
+        records = cache._records
+        for pkg in cache._cache.packages:
+            for ver in pkg.version_list:
+                records.lookup(ver.file_list[0])
+                src = srcmap["sources"][srcmap["source"][ver.id]]
+                self.assertEqual(src, records.source_pkg or pkg.name)
+                srcver = srcmap["source_versions"][
+                    srcmap["source_version"][ver.id]]
+                self.assertEqual(srcver, records.source_ver or ver.ver_str)
+                i = srcmap["source"][ver.id]
+                self.assertIn(ver.id, srcmap["versions"][
+                    srcmap["offsets"][i]:srcmap["offsets"][i + 1]])
+
+        # the second call is served from the stored map
+        self.assertEqual(cache._cache.source_map(), srcmap)
+
+        # a truncated or corrupt map is rebuilt
+        path = os.path.join(tmpdir, "pkgcache.bin.srcmap")
+        with open(path, "rb") as fobj:
+            data = fobj.read()
+        for corrupt in (data[:len(data) // 2],
+                        data[:8] + b"\xff\xff\xff\xff",
+                        data[:8] + b"\x01\x00\x00\x00\xff\xff\xff\x7f"):
+            with open(path, "wb") as fobj:
+                fobj.write(corrupt)
+            self.assertEqual(cache._cache.source_map(), srcmap)
+
     @if_sources_list_is_readable
     def test_dpkg_journal_dirty(self):
         # create tmp env
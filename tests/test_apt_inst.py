@@ -0,0 +1,323 @@
+#!/usr/bin/python3
+#
+# Copying and distribution of this file, with or without modification,
+# are permitted in any medium without royalty provided the copyright
+# notice and this notice are preserved.
+"""Unit tests for the apt_inst module."""
+import hashlib
+import io
+import os
+import shutil
+import tarfile
+import tempfile
+import unittest
+
+import apt_inst
+import apt_pkg
+
+import testcommon
+
+
+class TestTarFile(testcommon.TestCase):
+
+    XZ_DEB = os.path.join("data", "test_debs", "data-tar-xz.deb")
+    GZ_DEB = os.path.join("data", "test_debs", "gdebi-test11.deb")
+
+    def test_getnames(self):
+        deb = apt_inst.DebFile(self.XZ_DEB)
+        self.assertEqual(deb.data.getnames(), ["./", "usr/", "usr/bin/"])
+        names = []
+        deb.control.go(lambda item, data: names.append(item.name))
+        self.assertEqual(deb.control.getnames(), names)
+
+    def test_getmembers(self):
+        deb = apt_inst.DebFile(self.GZ_DEB)
+        members = deb.data.getmembers()
+        self.assertEqual([m.name for m in members], deb.data.getnames())
+        member = members[-1]
+        self.assertTrue(member.name.endswith("usr/bin/test"))
+        self.assertTrue(member.isfile())
+        self.assertEqual(member.size, 22)
+        self.assertTrue(members[0].isdir())
+
+    def test_go_without_data(self):
+        deb = apt_inst.DebFile(self.GZ_DEB)
+        items = []
+        deb.data.go(lambda item, data: items.append((item.name, data)),
+                    with_data=False)
+        self.assertEqual(items[-1][1], None)
+        items = []
+        deb.data.go(lambda item, data: items.append((item.name, data)))
+        self.assertEqual(items[-1][1], b'#!/bin/sh\necho "test"\n')
+
+    def test_extract_members(self):
+        deb = apt_inst.DebFile(self.GZ_DEB)
+        control = deb.control.extractdata("control")
+        self.assertEqual(deb.control.extract_members(["control", "md5sums"]),
+                         {"control": control})
+        self.assertEqual(deb.extract_control(["control"]),
+                         {"control": control})
+        self.assertEqual(deb.control.extract_members([]), {})
+
+        names = [m.name for m in deb.data.getmembers() if m.isfile()]
+        members = deb.data.extract_members()
+        self.assertEqual(sorted(members), sorted(names))
+        for name in names:
+            self.assertEqual(members[name], deb.data.extractdata(name))
+
+    def test_extractall(self):
+        tmpdir = tempfile.mkdtemp()
+        self.addCleanup(shutil.rmtree, tmpdir)
+        cwd = os.getcwd()
+        deb = apt_inst.DebFile(self.GZ_DEB)
+        member = deb.data.getmembers()[-1]
+        for _ in range(2):
+            self.assertTrue(deb.data.extractall(tmpdir))
+            self.assertEqual(os.getcwd(), cwd)
+            path = os.path.join(tmpdir, member.name)
+            with open(path, "rb") as fobj:
+                self.assertEqual(fobj.read(),
+                                 deb.data.extractdata(member.name))
+            self.assertEqual(os.stat(path).st_mtime, member.mtime)
+            self.assertEqual(os.stat(path).st_mode & 0o7777,
+                             member.mode & 0o7777)
+
+        self.assertTrue(deb.extract("control.tar.gz", tmpdir))
+        with open(os.path.join(tmpdir, "control.tar.gz"), "rb") as fobj:
+            self.assertEqual(fobj.read(), deb.extractdata("control.tar.gz"))
+
+    def _make_tar(self, tmpdir, members, name="test.tar.gz"):
+        """Create a tar file with members given as (name, type, link, data)."""
+        path = os.path.join(tmpdir, name)
+        with tarfile.open(path, "w:gz") as tar:
+            for name, type_, link, data in members:
+                info = tarfile.TarInfo(name)
+                info.type = type_
+                info.linkname = link
+                info.size = len(data)
+                info.mode = 0o755 if type_ == tarfile.DIRTYPE else 0o644
+                tar.addfile(info, io.BytesIO(data))
+        return path
+
+    def _make_deb(self, tmpdir, control, data):
+        """Create a .deb with the given control and data tar members."""
+        path = os.path.join(tmpdir, "test.deb")
+        parts = [("debian-binary", b"2.0\n"),
+                 ("control.tar.gz", self._make_tar(tmpdir, control,
+                                                   "control.tar.gz")),
+                 ("data.tar.gz", self._make_tar(tmpdir, data, "data.tar.gz"))]
+        with open(path, "wb") as deb:
+            deb.write(b"!<arch>\n")
+            for name, content in parts:
+                if not isinstance(content, bytes):
+                    with open(content, "rb") as fobj:
+                        content = fobj.read()
+                deb.write(("%-16s%-12d%-6d%-6d%-8s%-10d`\n" % (
+                    name, 0, 0, 0, "100644", len(content))).encode("ascii"))
+                deb.write(content)
+                if len(content) % 2:
+                    deb.write(b"\n")
+        return path
+
+    def test_hash_members_hardlink(self):
+        tmpdir = tempfile.mkdtemp()
+        self.addCleanup(shutil.rmtree, tmpdir)
+        data = [
+            ("./usr/", tarfile.DIRTYPE, "", b""),
+            ("./usr/file", tarfile.REGTYPE, "", b"data"),
+            ("./usr/hard", tarfile.LNKTYPE, "./usr/file", b""),
+        ]
+        hashes = apt_inst.TarFile(self._make_tar(tmpdir, data)).hash_members()
+        self.assertEqual(sorted(hashes), ["usr/file", "usr/hard"])
+        self.assertEqual(hashes["usr/hard"].find("MD5Sum").hashvalue,
+                         hashlib.md5(b"data").hexdigest())
+
+        md5 = hashlib.md5(b"data").hexdigest()
+        md5sums = ("%s  usr/file\n%s  usr/hard\n" % (md5, md5)).encode()
+        control = [("./md5sums", tarfile.REGTYPE, "", md5sums)]
+        deb = apt_inst.DebFile(self._make_deb(tmpdir, control, data))
+        self.assertEqual(deb.verify_md5sums(), [])
+
+    def test_extractall_links(self):
+        tmpdir = tempfile.mkdtemp()
+        self.addCleanup(shutil.rmtree, tmpdir)
+        target = os.path.join(tmpdir, "target")
+        os.mkdir(target)
+        path = self._make_tar(tmpdir, [
+            ("./", tarfile.DIRTYPE, "", b""),
+            ("./dir/", tarfile.DIRTYPE, "", b""),
+            ("./dir/file", tarfile.REGTYPE, "", b"data"),
+            ("./abs", tarfile.SYMTYPE, "/etc", b""),
+            ("./rel", tarfile.SYMTYPE, "../dir/file", b""),
+            ("./hard", tarfile.LNKTYPE, "./dir/file", b""),
+        ])
+        for _ in range(2):
+            self.assertTrue(apt_inst.TarFile(path).extractall(target))
+            self.assertEqual(os.readlink(os.path.join(target, "abs")), "/etc")
+            self.assertEqual(os.readlink(os.path.join(target, "rel")),
+                             "../dir/file")
+            self.assertTrue(os.path.samefile(
+                os.path.join(target, "hard"),
+                os.path.join(target, "dir", "file")))
+
+        # Replacing a file does not write to other links to it
+        path = self._make_tar(tmpdir, [
+            ("./hard", tarfile.REGTYPE, "", b"new"),
+        ])
+        self.assertTrue(apt_inst.TarFile(path).extractall(target))
+        with open(os.path.join(target, "dir", "file"), "rb") as fobj:
+            self.assertEqual(fobj.read(), b"data")
+
+    def test_extractall_outside(self):
+        tmpdir = tempfile.mkdtemp()
+        self.addCleanup(shutil.rmtree, tmpdir)
+        target = os.path.join(tmpdir, "target")
+        outside = os.path.join(tmpdir, "outside")
+        os.mkdir(target)
+        os.mkdir(outside)
+        with open(os.path.join(outside, "file"), "wb") as fobj:
+            fobj.write(b"secret")
+
+        for members in (
+                # through a symbolic link created by the archive
+                [("link", tarfile.SYMTYPE, outside, b""),
+                 ("link/file", tarfile.REGTYPE, "", b"evil")],
+                # a hard link to a file outside of the target
+                [("hard", tarfile.LNKTYPE, os.path.join(outside, "file"),
+                  b""),
+                 ("hard", tarfile.REGTYPE, "", b"evil")],
+                [("hard", tarfile.LNKTYPE, "../outside/file", b""),
+                 ("hard", tarfile.REGTYPE, "", b"evil")],
+                # names outside of the target
+                [("../outside/file", tarfile.REGTYPE, "", b"evil")],
+                [(os.path.join(outside, "file"), tarfile.REGTYPE, "",
+                  b"evil")]):
+            path = self._make_tar(tmpdir, members)
+            self.assertRaises(apt_pkg.Error,
+                              apt_inst.TarFile(path).extractall, target)
+            with open(os.path.join(outside, "file"), "rb") as fobj:
+                self.assertEqual(fobj.read(), b"secret")
+            self.assertEqual(os.listdir(outside), ["file"])
+
+    def test_build_index(self):
+        for path in (self.GZ_DEB, self.XZ_DEB,
+                     os.path.join("data", "test_debs", "data-tar.deb")):
+            deb = apt_inst.DebFile(path)
+            names = deb.data.getnames()
+            contents = [deb.data.extractdata(name) for name in names]
+            self.assertEqual(deb.data.build_index(), len(set(names)))
+            # In order, backwards, and again after a rebuild
+            for _ in range(2):
+                for name, content in zip(names, contents):
+                    self.assertEqual(deb.data.extractdata(name), content)
+                for name, content in reversed(list(zip(names, contents))):
+                    self.assertEqual(deb.data.extractdata(name), content)
+                deb.data.build_index()
+            self.assertRaises(LookupError, deb.data.extractdata, "nonexistent")
+
+    def test_hash_members(self):
+        deb = apt_inst.DebFile(self.GZ_DEB)
+        content = deb.data.extractdata("usr/bin/test")
+        hashes = deb.data.hash_members()
+        self.assertEqual(sorted(hashes), ["usr/bin/test"])
+        hashlist = hashes["usr/bin/test"]
+        self.assertEqual(hashlist.find("MD5Sum").hashvalue,
+                         hashlib.md5(content).hexdigest())
+        self.assertEqual(hashlist.find("SHA256").hashvalue,
+                         hashlib.sha256(content).hexdigest())
+        self.assertRaises(KeyError, hashlist.find, "SHA1")
+        hashlist = deb.data.hash_members(["SHA512"])["usr/bin/test"]
+        self.assertEqual(hashlist.find("SHA512").hashvalue,
+                         hashlib.sha512(content).hexdigest())
+        self.assertRaises(ValueError, deb.data.hash_members, ["crc32"])
+
+    def test_verify_md5sums(self):
+        path = os.path.join("data", "test_debs", "utf8-package_1.0-1_all.deb")
+        self.assertEqual(apt_inst.DebFile(path).verify_md5sums(), [])
+        self.assertRaises(LookupError,
+                          apt_inst.DebFile(self.GZ_DEB).verify_md5sums)
+
+    def test_open_member(self):
+        deb = apt_inst.DebFile(self.GZ_DEB)
+        name = deb.data.getnames()[-1]
+        content = deb.data.extractdata(name)
+        with deb.data.open_member(name) as reader:
+            self.assertEqual(reader.size, len(content))
+            self.assertEqual(reader.read(5), content[:5])
+            buf = bytearray(4)
+            self.assertEqual(reader.readinto(buf), 4)
+            self.assertEqual(bytes(buf), content[5:9])
+            # The archive is in use until the reader is closed
+            self.assertRaises(ValueError, deb.data.getnames)
+            self.assertEqual(reader.read(), content[9:])
+            self.assertEqual(reader.read(), b"")
+            self.assertEqual(reader.readinto(buf), 0)
+        self.assertTrue(reader.closed)
+        self.assertRaises(ValueError, reader.read)
+        self.assertEqual(deb.data.extractdata(name), content)
+
+        # Closing a reader before the end releases the archive as well
+        reader = deb.data.open_member(name)
+        reader.close()
+        self.assertRaises(LookupError, deb.data.open_member, "nonexistent")
+
+
+class TestArArchive(testcommon.TestCase):
+
+    DEB = os.path.join("data", "test_debs", "gdebi-test11.deb")
+
+    def test_mmap(self):
+        plain = apt_inst.ArArchive(self.DEB)
+        mapped = apt_inst.ArArchive(self.DEB, mmap=True)
+        for name in plain.getnames():
+            view = mapped.extractdata(name)
+            self.assertIsInstance(view, memoryview)
+            self.assertTrue(view.readonly)
+            self.assertEqual(bytes(view), plain.extractdata(name))
+        view = mapped.extractdata("debian-binary")
+        del mapped
+        self.assertEqual(bytes(view), b"2.0\n")
+        self.assertRaises(BufferError, memoryview, plain)
+
+        deb = apt_inst.DebFile(self.DEB, mmap=True)
+        self.assertEqual(deb.debian_binary, b"2.0\n")
+        self.assertEqual(bytes(deb.extractdata("control.tar.gz")),
+                         plain.extractdata("control.tar.gz"))
+
+    def test_iter(self):
+        archive = apt_inst.ArArchive(self.DEB)
+        iterator = iter(archive)
+        self.assertIs(iter(iterator), iterator)
+        self.assertEqual([member.name for member in iterator],
+                         archive.getnames())
+        self.assertEqual(list(iterator), [])
+
+
+class TestScanDebs(testcommon.TestCase):
+
+    def test_scan_debs(self):
+        debdir = os.path.join("data", "test_debs")
+        paths = [os.path.join(debdir, name) for name in os.listdir(debdir)
+                 if name.startswith("gdebi-test")]
+        results = dict(apt_inst.scan_debs(paths, threads=3))
+        self.assertEqual(sorted(results), sorted(paths))
+        for path in paths:
+            deb = apt_inst.DebFile(path)
+            self.assertEqual(sorted(results[path]),
+                             ["control", "filelist", "md5sums"])
+            self.assertEqual(results[path]["control"],
+                             deb.control.extractdata("control"))
+            self.assertEqual(results[path]["filelist"], deb.data.getnames())
+
+    def test_scan_debs_errors(self):
+        paths = [os.path.join("data", "test_debs", "gdebi-test11.deb"),
+                 os.path.join("data", "test_debs", "does-not-exist.deb")]
+        results = dict(apt_inst.scan_debs(paths, want=["conffiles"]))
+        self.assertEqual(results[paths[0]], {"conffiles": None})
+        self.assertIsInstance(results[paths[1]], apt_inst.Error)
+        self.assertEqual(list(apt_inst.scan_debs([])), [])
+        self.assertRaises(ValueError, apt_inst.scan_debs, paths, threads=-1)
+
+
+if __name__ == "__main__":
+    unittest.main()
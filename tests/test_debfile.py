@@ -184,6 +184,10 @@ Description: testpackage for gdebi - contains usr/bin/binary for file reading
         deb = apt.debfile.DebPackage("./data/test_debs/gdebi-test13.deb")
         data = deb.data_content("./lala.gz")
         self.assertEqual(data, "Automatically decompressed:\n\nlala\n")
+        # later lookups use the index
+        self.assertEqual(deb.data_content("./lala.gz"), data)
+        self.assertEqual(deb.data_content("nonexistent"), "")
+        self.assertEqual(deb.data_content("lala.gz"), data)
 
 
 if __name__ == "__main__":
@@ -88,6 +88,63 @@ class TestHashes(testcommon.TestCase):
         self.assertRaises(TypeError, apt_pkg.sha1sum, "D")
         self.assertRaises(TypeError, apt_pkg.sha256sum, "D")
 
+    def test_update(self):
+        """hashes: Test apt_pkg.Hashes.update()."""
+        for parallel in (False, True):
+            hashes = apt_pkg.Hashes(types=["md5", "sha256"],
+                                    parallel=parallel)
+            value = memoryview(self.value)
+            hashes.update(bytearray(value[:10]))
+            hashes.update(value[10:200000])
+            hashes.update(value[200000:])
+            hashes.update(b"")
+            result = hashes.hashes
+            self.assertEqual(result.find("md5sum").hashvalue, self.md5)
+            self.assertEqual(result.find("sha256").hashvalue, self.sha256)
+            self.assertEqual(result.file_size, len(self.value))
+            # Reading the hashes finalizes them
+            self.assertRaises(ValueError, hashes.update, b"x")
+
+        hashes = apt_pkg.Hashes(self.value[:100])
+        hashes.update(self.value[100:])
+        self.assertEqual(hashes.hashes.find("sha1").hashvalue, self.sha1)
+        self.assertRaises(TypeError, apt_pkg.Hashes().update, "D")
+
+    def test_types(self):
+        """hashes: Test apt_pkg.Hashes(types=...)."""
+        for obj in (self.value, self.file):
+            self.file.seek(0)
+            hashes = apt_pkg.Hashes(obj, types=["sha256"]).hashes
+            self.assertEqual(hashes.find("sha256"),
+                             apt_pkg.HashString("SHA256", self.sha256))
+            self.assertRaises(KeyError, hashes.find, "md5sum")
+            self.assertRaises(KeyError, hashes.find, "sha1")
+            self.assertEqual(hashes.file_size, len(self.value))
+        self.assertRaises(ValueError, apt_pkg.Hashes, self.value,
+                          types=["crc32"])
+        self.assertRaises(ValueError, apt_pkg.Hashes, self.value, types=[])
+
+    def test_parallel(self):
+        """hashes: Test apt_pkg.Hashes(parallel=True)."""
+        for obj in (self.value, self.file):
+            self.file.seek(0)
+            hashes = apt_pkg.Hashes(obj, parallel=True).hashes
+            self.assertEqual(hashes.find("md5sum"),
+                             apt_pkg.HashString("MD5Sum", self.md5))
+            self.assertEqual(hashes.find("sha1"),
+                             apt_pkg.HashString("SHA1", self.sha1))
+            self.assertEqual(hashes.find("sha256"),
+                             apt_pkg.HashString("SHA256", self.sha256))
+            self.assertEqual(hashes.file_size, len(self.value))
+
+            self.file.seek(0)
+            hashes = apt_pkg.Hashes(obj, types=["sha256", "sha512"],
+                                    parallel=True).hashes
+            self.assertEqual(hashes.find("sha256").hashvalue, self.sha256)
+            self.assertEqual(hashes.find("sha512").hashvalue,
+                             hashlib.sha512(self.value).hexdigest())
+            self.assertRaises(KeyError, hashes.find, "md5sum")
+
 
 class TestHashString(testcommon.TestCase):
     """Test apt_pkg.HashString()."""
@@ -17,6 +17,7 @@ libdir = get_library_dir()
 if libdir:
     sys.path.insert(0, libdir)
 from apt.progress.base import InstallProgress
+import apt_pkg
 
 import testcommon
 
@@ -29,6 +30,22 @@ class RunHelper:
         return os.spawnl(os.P_WAIT, self.script, self.script, str(fd))
 
 
+class StatusHelper:
+    def do_install(self, fd):
+        for percent in range(0, 100, 10):
+            os.write(fd, b"pmstatus:pkg:%d:Installing pkg\n" % percent)
+        return 3
+
+
+class RecordingProgress(InstallProgress):
+    def __init__(self):
+        InstallProgress.__init__(self)
+        self.changes = []
+
+    def status_change(self, pkg, percent, status):
+        self.changes.append((pkg, percent, status))
+
+
 class TestInstallProgressExec(testcommon.TestCase):
     """ test that InstallProgress.run() passes a valid file descriptor to
         a child process """
@@ -37,6 +54,29 @@ class TestInstallProgressExec(testcommon.TestCase):
         with InstallProgress() as prog:
             self.assertEqual(prog.run(RunHelper()), 0)
 
+    def test_run_status(self):
+        with RecordingProgress() as prog:
+            self.assertEqual(prog.run(StatusHelper()), 3)
+        self.assertEqual([percent for (_, percent, _) in prog.changes],
+                         [float(p) for p in range(0, 100, 10)])
+
+    def test_wait_child(self):
+        (readfd, writefd) = os.pipe()
+        pid = os.fork()
+        if pid == 0:
+            os.write(writefd, b"x")
+            os._exit(7)
+        os.close(writefd)
+        calls = []
+
+        def callback():
+            calls.append(os.read(readfd, 1))
+        res = apt_pkg.wait_child(pid, readfd, callback)
+        os.close(readfd)
+        self.assertTrue(os.WIFEXITED(res))
+        self.assertEqual(os.WEXITSTATUS(res), 7)
+        self.assertEqual(calls[0], b"x")
+
 
 if __name__ == "__main__":
     os.chdir(os.path.dirname(__file__))
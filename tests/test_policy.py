@@ -8,6 +8,9 @@
 
 import apt
 import apt_pkg
+import fnmatch
+import re
+import tempfile
 import unittest
 
 import testcommon
@@ -56,6 +59,60 @@ class TestAptPolicy(testcommon.TestCase):
                 policy.get_priority(ver)
                 dpolicy.get_priority(ver)
 
+    def test_apt_policy_lowlevel_bulk(self):
+        cache = apt_pkg.Cache(progress=None)
+        policy = cache.policy
+
+        candidates = policy.candidates()
+        self.assertEqual(len(candidates), cache.package_count)
+        priorities = policy.priorities()
+        self.assertEqual(len(priorities), cache.version_count)
+
+        pkgs = list(cache.packages)[:50]
+        self.assertEqual(len(policy.candidates(pkgs)), len(pkgs))
+        for pkg, cand_id in zip(pkgs, policy.candidates(pkgs)):
+            cand = policy.get_candidate_ver(pkg)
+            self.assertEqual(cand_id, cand.id if cand else -1)
+            self.assertEqual(candidates[pkg.id], cand_id)
+            for ver in pkg.version_list:
+                self.assertEqual(priorities[ver.id],
+                                 policy.get_priority(ver))
+                self.assertEqual(list(policy.priorities([ver])),
+                                 [policy.get_priority(ver)])
+
+        self.assertRaises(TypeError, policy.candidates, [None])
+
+    def test_apt_policy_stats(self):
+        cache = apt_pkg.Cache(progress=None)
+        policy = apt_pkg.Policy(cache)
+        self.assertEqual(policy.stats(), [])
+        with tempfile.NamedTemporaryFile("w", suffix=".pref") as pref:
+            pref.write("Package: apt\n"
+                       "Pin: release a=experimental\n"
+                       "Pin-Priority: 600\n\n"
+                       "Package: apt* /^libapt/\n"
+                       "Pin: origin example.org\n"
+                       "Pin-Priority: 100\n")
+            pref.flush()
+            self.assertTrue(policy.read_pinfile(pref.name))
+            self.assertEqual(policy.stats()[0]["pins"], [])
+            self.assertEqual(policy.compile(), 3)
+
+        stats = policy.stats()
+        self.assertEqual([(s["file"], s["result"]) for s in stats],
+                         [(pref.name, True)])
+        self.assertTrue(stats[0]["time"] >= 0)
+        self.assertEqual([(p["package"], p["kind"]) for p in stats[0]["pins"]],
+                         [("apt", "exact"), ("apt*", "glob"),
+                          ("/^libapt/", "regex")])
+        names = set(pkg.name for pkg in cache.packages)
+        self.assertEqual([p["matches"] for p in stats[0]["pins"]],
+                         [int("apt" in names),
+                          len(fnmatch.filter(names, "apt*")),
+                          len([n for n in names if re.match("libapt", n)])])
+        for pin in stats[0]["pins"]:
+            self.assertTrue(pin["time"] >= 0)
+
     def test_apt_policy_highlevel(self):
         return  # TODO: Make tests independent of system state
         cache = apt.Cache()
@@ -103,6 +103,32 @@ class TestSourceRecords(testcommon.TestCase):
 
         self.assertFalse(src.step())
 
+    def test_source_records_lookup(self):
+        src = apt_pkg.SourceRecords()
+        self.assertTrue(src.lookup("dh-autoreconf"))
+        self.assertEqual(src.package, "dh-autoreconf")
+        self.assertEqual(src.files[0].path, "dh-autoreconf_16.dsc")
+        # each lookup moves forward, a miss restarts
+        self.assertEqual(src.lookup("dh-autoreconf"), None)
+        self.assertTrue(src.lookup("dh-autoreconf"))
+        self.assertEqual(src.lookup("does-not-exist"), None)
+        self.assertTrue(src.step())
+        self.assertEqual(src.package, "dh-autoreconf")
+
+    def test_source_records_lookup_many(self):
+        src = apt_pkg.SourceRecords()
+        self.assertTrue(src.step())
+        records = src.lookup_many(["dh-autoreconf", "does-not-exist"])
+        self.assertEqual(set(records), set(["dh-autoreconf",
+                                            "does-not-exist"]))
+        self.assertEqual(records["does-not-exist"], [])
+        self.assertEqual(len(records["dh-autoreconf"]), 1)
+        section = apt_pkg.TagSection(records["dh-autoreconf"][0])
+        self.assertEqual(section["Package"], "dh-autoreconf")
+        # the position is kept
+        self.assertEqual(src.package, "dh-autoreconf")
+        self.assertFalse(src.step())
+
 
 if __name__ == "__main__":
     unittest.main()
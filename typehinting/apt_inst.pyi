@@ -1,10 +1,16 @@
 from typing import *
 
+from apt_pkg import HashStringList
+
 class ArArchive:
+    def __init__(self, file: object, mmap: bool = False) -> None: ...
     def extract(self) -> None: ...
+    def extractdata(self, name: str) -> Union[bytes, memoryview]: ...
 
 class DebFile:
-    def __init__(self, file: object) -> None: ...
+    def __init__(self, file: object, mmap: bool = False) -> None: ...
+    def extract_control(self, names: Optional[Sequence[str]] = None) -> Dict[str, bytes]: ...
+    def verify_md5sums(self) -> List[str]: ...
     control: TarFile
     data: TarFile
 
@@ -30,6 +36,25 @@ class TarMember:
     uid: int
 
 class TarFile:
+    def build_index(self) -> int: ...
     def extractall(self, rootdir: str = '') -> None: ...
     def extractdata(self, member: str) -> bytes: ...
-    def go(self, callback: Callable[[TarMember, bytes], None], member : str = '') -> None: ...
+    def extract_members(self, names: Optional[Sequence[str]] = None) -> Dict[str, bytes]: ...
+    def getmembers(self) -> List[TarMember]: ...
+    def hash_members(self, types: Sequence[str] = ...) -> Dict[str, HashStringList]: ...
+    def getnames(self) -> List[str]: ...
+    def go(self, callback: Callable[[TarMember, Optional[bytes]], None], member : str = '', with_data: bool = True) -> None: ...
+    def open_member(self, member: str) -> TarMemberReader: ...
+
+class TarMemberReader:
+    def read(self, size: int = -1) -> bytes: ...
+    def readinto(self, buffer: Union[bytearray, memoryview]) -> int: ...
+    def readable(self) -> bool: ...
+    def close(self) -> None: ...
+    def __enter__(self) -> TarMemberReader: ...
+    def __exit__(self, *args: object) -> bool: ...
+    closed: bool
+    name: str
+    size: int
+
+def scan_debs(paths: Sequence[str], want: Sequence[str] = ..., threads: int = 0) -> Iterator[Tuple[str, Union[Dict[str, Any], Exception]]]: ...
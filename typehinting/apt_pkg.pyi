@@ -1,3 +1,4 @@
+import array
 from typing import *
 
 from apt.progress.base import (
@@ -123,6 +124,7 @@ class PackageRecords():
     hashes: HashStringList
     def __init__(self, cache: Cache) -> None: ...
     def lookup(self, packagefile: Tuple[PackageFile, int], index: int=0) -> bool: ...
+    def lookup_many(self, pairs: Sequence[Tuple[PackageFile, int]], fields: Sequence[str]) -> List[Tuple[str, ...]]: ...
 
 class PackageFile:
     architecture: str
@@ -177,19 +179,27 @@ def pkgsystem_lock_inner() -> None: ...
 def pkgsystem_unlock_inner() -> None: ...
 def pkgsystem_is_locked() -> bool: ...
 
+def wait_child(pid: int, fd: int=-1, callback: Optional[Callable[[], object]]=None, timeout: float=-1) -> int: ...
+
 SELSTATE_HOLD: int
 
 class Acquire:
+    STATS_FIELDS: Tuple[str, ...]
+    event_fd: int
     fetch_needed: int
     items: List[AcquireItem]
     partial_present: int
+    stats: memoryview
     total_needed: int
     workers: List[AcquireWorker]
     RESULT_CANCELLED: int
     RESULT_FAILED: int
     RESULT_CONTINUE: int
-    def __init__(self, progress: Optional[AcquireProgress]=None) -> None: ...
-    def run(self) -> int: ...
+    def __init__(self, progress: Optional[AcquireProgress]=None, events: bool=False, stats_interval: float=0, queue_mode: Optional[str]=None, max_parallel: int=0, per_host: int=0, rate_limit: int=0) -> None: ...
+    def run(self, pulse_interval: int=500000) -> int: ...
+    def run_async(self, pulse_interval: int=500000) -> Awaitable[int]: ...
+    def item_stats(self) -> List[Dict[str, Any]]: ...
+    def poll_events(self) -> List[Tuple[str, str, str, str, int, int, str]]: ...
     def shutdown(self) -> None: ...
     def get_lock(self, path: str) -> None: ...
 
@@ -227,7 +237,8 @@ class AcquireItemDesc:
     uri: str
 
 class Hashes:
-    def __init__(self, object: Union[bytes, FileLike, int]) -> None: ...
+    def __init__(self, object: Union[bytes, FileLike, int] = ..., types: Optional[Sequence[str]] = None, parallel: bool = False) -> None: ...
+    def update(self, data: Union[bytes, bytearray, memoryview]) -> None: ...
     hashes: HashStringList
 
 class HashString:
@@ -247,6 +258,7 @@ class HashStringList:
     usable: bool
 
 class AcquireFile(AcquireItem):
+    received_hashes: Optional[HashStringList]
     def __init__(self, owner: Acquire, uri: str, hash: Optional[Union[HashStringList, str]], size: int=0, descr: str="", short_descr: str="", destdir: str="", destfile: str="") -> None: ...
 
 class IndexFile:
@@ -267,6 +279,7 @@ class SourceRecordFiles:
 
 class SourceRecords:
     def lookup(self, name: str) -> bool: ...
+    def lookup_many(self, names: Sequence[str]) -> Dict[str, List[str]]: ...
     def restart(self) -> None: ...
     def step(self) -> bool: ...
     binaries: List[str]
@@ -303,7 +316,8 @@ class Cache():
     def __contains__(self, name: Union[str, Tuple[str, str]]) -> Package: ...
     def __getitem__(self, name: Union[str, Tuple[str, str]]) -> Package: ...
     def __len__(self) -> int: ...
-    def update(self, progress: AcquireProgress, sources: SourceList, pulse_interval: int) -> int: ...
+    def update(self, progress: Optional[AcquireProgress], sources: SourceList, pulse_interval: int) -> int: ...
+    def source_map(self) -> Dict[str, Any]: ...
     
 class DepCache():
     broken_count: int
@@ -328,6 +342,7 @@ class DepCache():
     def is_auto_installed(self, pkg: Package) -> bool: ...
     def is_inst_broken(self, pkg: Package) -> bool: ...
     def is_now_broken(self, pkg: Package) -> bool: ...
+    def changes_since(self, token: int=0) -> Tuple[int, Optional[List[Package]]]: ...
 
     def mark_keep(self, pkg: Package) -> None: ...
     def mark_install(self, pkg: Package, auto_inst: bool=True, from_user: bool=True) -> None: ...
@@ -340,6 +355,11 @@ class DepCache():
 
 class Policy():
     def get_priority(self, pkg: Union[PackageFile, Version]) -> int: ...
+    def candidates(self, packages: Optional[Sequence[Package]]=None) -> array.array: ...
+    def priorities(self, versions: Optional[Sequence[Version]]=None) -> array.array: ...
+    def read_pinfile(self, filename: str) -> bool: ...
+    def read_pindir(self, dirname: str) -> bool: ...
+    def stats(self) -> List[Dict[str, Any]]: ...
 
 class SystemLock():
     def __enter__(self) -> None: ...
@@ -0,0 +1,79 @@
+#!/usr/bin/python3
+#  extract-benchmark.py - Compare apt_inst extraction with dpkg-deb -x.
+#
+#  This program is free software; you can redistribute it and/or
+#  modify it under the terms of the GNU General Public License as
+#  published by the Free Software Foundation; either version 2 of the
+#  License, or (at your option) any later version.
+#
+#  This program is distributed in the hope that it will be useful,
+#  but WITHOUT ANY WARRANTY; without even the implied warranty of
+#  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#  GNU General Public License for more details.
+#
+#  You should have received a copy of the GNU General Public License
+#  along with this program; if not, write to the Free Software
+#  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+#  MA 02110-1301, USA.
+"""Extract the data of the given packages with DebFile.data.extractall()
+and with dpkg-deb -x, and print the best time of each over several runs.
+
+Usage: extract-benchmark.py [--runs N] [--dir DIR] package.deb...
+
+Use large packages, such as -dbgsym packages, and a target directory on
+the file system you care about; the default is a temporary directory.
+"""
+from __future__ import print_function
+import argparse
+import os
+import shutil
+import subprocess
+import tempfile
+import time
+
+import apt_inst
+
+
+def apt_inst_extract(path, target):
+    apt_inst.DebFile(path).data.extractall(target)
+
+
+def dpkg_deb_extract(path, target):
+    subprocess.check_call(["dpkg-deb", "-x", path, target])
+
+
+def best_time(func, path, runs, basedir):
+    best = None
+    for _ in range(runs):
+        target = tempfile.mkdtemp(dir=basedir)
+        try:
+            start = time.monotonic()
+            func(path, target)
+            elapsed = time.monotonic() - start
+        finally:
+            shutil.rmtree(target)
+        if best is None or elapsed < best:
+            best = elapsed
+    return best
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("--runs", type=int, default=3)
+    parser.add_argument("--dir", default=None,
+                        help="directory to extract into")
+    parser.add_argument("packages", nargs="+")
+    args = parser.parse_args()
+
+    print("%-40s %10s %12s %12s %8s" % ("package", "MiB", "apt_inst",
+                                        "dpkg-deb", "ratio"))
+    for path in args.packages:
+        size = os.path.getsize(path) / 1024.0 / 1024.0
+        ours = best_time(apt_inst_extract, path, args.runs, args.dir)
+        dpkg = best_time(dpkg_deb_extract, path, args.runs, args.dir)
+        print("%-40s %10.1f %11.3fs %11.3fs %8.2f" % (
+            os.path.basename(path)[:40], size, ours, dpkg, ours / dpkg))
+
+
+if __name__ == "__main__":
+    main()